@@ -0,0 +1,12 @@
+#ifndef _ALLOCATIONS
+#define _ALLOCATIONS
+
+// Heap allocation accounting. Linking this file replaces the global operator new with one that
+// counts the allocations of the calling thread, so a stage of the hop path can tell how many it
+// made from the count before and after it. The count is thread local: keeping it costs an
+// increment and adds no contention between the sessions' threads.
+
+// Allocations made through operator new by the calling thread since it started
+unsigned long long thread_allocations();
+
+#endif
@@ -1,33 +1,29 @@
-// adapted from:
-// https://github.com/GiantSteps/MC-Sonaar/blob/431048b80b86c29d9caac28ee23061cdf1013b13/essentiaRT~/EssentiaSFX.cpp
+#include <cmath>
+
+#include "Allocations.hpp"
 #include "Analyzer.hpp"
 
-Analyzer::Analyzer() { essentia::init(); }
-
-Analyzer::~Analyzer() {}
-
-void Analyzer::configure_subscription(std::vector<std::string> features) {
-    // initialize default feature subscription with all falses
-    subscription_ = FeatureSubscription();
-    subscription_["rms"] = false;
-    subscription_["energy"] = false;
-    subscription_["spectrum"] = false;
-    subscription_["centroid"] = false;
-    subscription_["loudness"] = false;
-    subscription_["noisiness"] = false;
-    subscription_["pitch"] = false;
-    subscription_["mfcc"] = false;
-    subscription_["dissonance"] = false;
-    subscription_["key"] = false;
-    subscription_["tristimulus"] = false;
-    subscription_["spectral_contrast"] = false;
-    subscription_["spectral_complexity"] = false;
-    subscription_["chroma"] = false; // TODO: fix - needs input frame size of 32768
-    subscription_["onset"] = false;
-    // insert true values for features provided
-    for (auto const& feature : features) {
-        subscription_[feature] = true;
-    }
+// frames whose sequence and receive time are kept while they wait to be analysed
+#define MAX_PENDING_FRAMES 4096
+
+static uint64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+// essentia::init() must be called once per process before any Analyzer is started
+Analyzer::Analyzer(unsigned int id, PipelineCache& pipelines)
+    : id_(id), memory_(0), schema_(std::make_shared<FeatureSchema>()),
+      metrics_(std::make_shared<SessionMetrics>()),
+      drain_timer_(Metrics::instance().stage("drain")),
+      analysis_timer_(Metrics::instance().stage("analysis")), pipelines_(pipelines) {
+    Metrics::instance().add_session(id_, metrics_.get());
+}
+
+Analyzer::~Analyzer() {
+    end_session();
+    Metrics::instance().remove_session(id_);
 }
 
 bool Analyzer::is_busy() {
@@ -38,229 +34,117 @@ bool Analyzer::is_busy() {
 void Analyzer::start_session(ClientConnection conn, unsigned int sample_rate, unsigned int hop_size,
                              unsigned int memory, std::vector<std::string> features) {
     conn_ = conn;
-    configure_subscription(features);
     std::clog << "Analyzer session initiated with sample rate: " << std::to_string(sample_rate)
               << std::endl;
     sample_rate_ = sample_rate;
     features_ = features;
-    busy_ = true;
     hop_size_ = hop_size;
     memory_ = memory;
-    window_size_ = hop_size * memory;
-    frame_count_ = 0;
-    ending_ = false;
-
-    combine_ms_ = 50;
-    window_.resize(window_size_);
-
-    // input
-    gen_ = new VectorInput<Real>();
-    gen_->setVector(&window_);
-
-    // setup
-    AlgorithmFactory& factory = AlgorithmFactory::instance();
-    standard::AlgorithmFactory& standard_factory = standard::AlgorithmFactory::instance();
-
-    // create algorithms
-    frame_cutter_ = factory.create("FrameCutter", "frameSize", window_size_, "hopSize", hop_size_,
-                                   "startFromZero", true, "validFrameThresholdRatio", .1,
-                                   "lastFrameToEndOfFile", true, "silentFrames", "keep");
-    windowing_ = factory.create("Windowing", "type", "square", "zeroPhase", true);
-
-    spectrum_ = factory.create("Spectrum");
-    spectral_peaks_ = factory.create("SpectralPeaks", "sampleRate", sample_rate_);
-
-    if (subscription_["rms"]) {
-        rms_ = factory.create("RMS");
-    }
-
-    if (subscription_["energy"]) {
-        energy_ = factory.create("Energy");
-    }
-
-    if (subscription_["centroid"]) {
-        centroid_ = factory.create("Centroid");
-    }
-
-    if (subscription_["loudness"]) {
-        loudness_ = factory.create("InstantPower");
-    }
-
-    if (subscription_["noisiness"]) {
-        flatness_ = factory.create("Flatness");
-    }
-
-    if (subscription_["pitch"]) {
-        yin_ = factory.create("PitchYinFFT");
-    }
-
-    if (subscription_["mfcc"]) {
-        mfcc_ = factory.create("MFCC", "inputSize", window_size_ / 2 + 1);
-    }
-
-    if (subscription_["dissonance"]) {
-        dissonance_ = factory.create("Dissonance");
-    }
-
-    if (subscription_["key"]) {
-        hpcp_ = factory.create("HPCP", "size", 48);
-        key_ = factory.create("Key");
-    }
 
-    if (subscription_["tristimulus"]) {
-        tristimulus_ = factory.create("Tristimulus");
-    }
-
-    if (subscription_["spectral_contrast"]) {
-        spectral_contrast_ = factory.create("SpectralContrast");
-    }
-
-    if (subscription_["spectral_complexity"]) {
-        spectral_complexity_ = factory.create("SpectralComplexity");
-    }
-
-    if (subscription_["chroma"]) {
-        chroma_ = factory.create("Chromagram");
-    }
-
-    if (subscription_["onset"]) {
-        triangle_bands_ = factory.create("TriangularBands", "log", false);
-        super_flux_novelty_ = factory.create("SuperFluxNovelty", "binWidth", 5, "frameWidth", 1);
-        super_flux_peaks_ = factory.create("SuperFluxPeaks", "ratioThreshold", 4, "threshold",
-                                           .7 / NOVELTY_MULT, "pre_max", 80, "pre_avg", 120,
-                                           "frameRate", sample_rate_ * 1.0 / hop_size_, "combine",
-                                           combine_ms_);
-        super_flux_peaks_->input(0).setAcquireSize(1);
-        super_flux_peaks_->input(0).setReleaseSize(1);
-    }
-
-    // Aggregation
-    const char* stats[] = {"mean", "var"};
-    aggregator_ = standard_factory.create("PoolAggregator", "defaultStats",
-                                          arrayToVector<std::string>(stats));
-
-    // connect the algorithms
-    gen_->output("data") >> frame_cutter_->input("signal");
-    frame_cutter_->output("frame") >> windowing_->input("frame");
-    windowing_->output("frame") >> spectrum_->input("frame");
-    spectrum_->output("spectrum") >> spectral_peaks_->input("spectrum");
-
-    if (subscription_["spectrum"]) {
-        spectrum_->output("spectrum") >> PC(sfx_pool_, "spectrum");
-    }
-
-    if (subscription_["rms"]) {
-        windowing_->output("frame") >> rms_->input("array");
-        rms_->output("rms") >> PC(sfx_pool_, "rms");
-    }
-
-    if (subscription_["energy"]) {
-        windowing_->output("frame") >> energy_->input("array");
-        energy_->output("energy") >> PC(sfx_pool_, "energy");
-    }
-
-    if (subscription_["centroid"]) {
-        spectrum_->output("spectrum") >> centroid_->input("array");
-        centroid_->output("centroid") >> PC(sfx_pool_, "centroid");
-    }
-
-    if (subscription_["loudness"]) {
-        frame_cutter_->output("frame") >> loudness_->input("array");
-        loudness_->output("power") >> PC(sfx_pool_, "loudness");
-    }
-
-    if (subscription_["noisiness"]) {
-        spectrum_->output("spectrum") >> flatness_->input("array");
-        flatness_->output("flatness") >> PC(sfx_pool_, "noisiness");
-    }
-
-    if (subscription_["pitch"]) {
-        spectrum_->output("spectrum") >> yin_->input("spectrum");
-        yin_->output("pitch") >> PC(sfx_pool_, "f0");
-        yin_->output("pitchConfidence") >> PC(sfx_pool_, "f0_fonfidence");
-    }
-
-    if (subscription_["mfcc"]) {
-        spectrum_->output("spectrum") >> mfcc_->input("spectrum");
-        mfcc_->output("bands") >> NOWHERE;
-        mfcc_->output("mfcc") >> PC(sfx_pool_, "mfcc");
-    }
-
-    if (subscription_["dissonance"]) {
-        spectral_peaks_->output("frequencies") >> dissonance_->input("frequencies");
-        spectral_peaks_->output("magnitudes") >> dissonance_->input("magnitudes");
-        dissonance_->output("dissonance") >> PC(sfx_pool_, "dissonance");
-    }
-
-    if (subscription_["key"]) {
-        spectral_peaks_->output("frequencies") >> hpcp_->input("frequencies");
-        spectral_peaks_->output("magnitudes") >> hpcp_->input("magnitudes");
-        hpcp_->output("hpcp") >> key_->input("pcp");
-        key_->output("key") >> PC(sfx_pool_, "key");
-        key_->output("scale") >> PC(sfx_pool_, "scale");
-        key_->output("strength") >> PC(sfx_pool_, "key_strength");
+    // hops keep their duration at the analysis rate
+    resampler_.reset();
+    if (analysis_rate_ > 0 && analysis_rate_ != sample_rate) {
+        if (Resampler::supported(sample_rate, analysis_rate_)) {
+            resampler_.reset(new Resampler(sample_rate, analysis_rate_, channels_));
+            hop_size_ = std::max<long>(1, std::lround(double(hop_size) * analysis_rate_ /
+                                                      sample_rate));
+            sample_rate_ = analysis_rate_;
+            std::clog << "Resampling to " << sample_rate_ << " Hz, hop size " << hop_size_
+                      << std::endl;
+        } else {
+            std::clog << "Cannot resample " << sample_rate << " Hz audio to " << analysis_rate_
+                      << " Hz, analysing it as is" << std::endl;
+        }
     }
+    window_size_ = hop_size_ * memory;
+    frame_count_ = 0;
+    ending_ = false;
 
-    if (subscription_["tristimulus"]) {
-        spectral_peaks_->output("frequencies") >> tristimulus_->input("frequencies");
-        spectral_peaks_->output("magnitudes") >> tristimulus_->input("magnitudes");
-        tristimulus_->output("tristimulus") >> PC(sfx_pool_, "tristimulus");
+    config_ = PipelineConfig(sample_rate_, hop_size_, memory_, features_, streaming_, stats_,
+                             horizon_);
+    plan_ = FeatureGraph::instance().plan(config_);
+    auto stream_schema = std::make_shared<FeatureSchema>(plan_, config_);
+
+    // every channel and mix is analysed alike, by pipelines sharing the plan and the FFT plans
+    stream_names_.clear();
+    for (unsigned int channel = 0; channel < channels_; channel++) {
+        stream_names_.push_back("ch" + std::to_string(channel));
+    }
+    if (mix_ == MIX_SUM) {
+        stream_names_.push_back("sum");
+    } else if (mix_ == MIX_MID_SIDE) {
+        stream_names_.push_back("mid");
+        stream_names_.push_back("side");
+    }
+
+    schema_ = stream_names_.size() > 1
+                  ? std::make_shared<FeatureSchema>(*stream_schema, stream_names_)
+                  : stream_schema;
+
+    streams_.clear();
+    streams_.resize(stream_names_.size());
+    for (size_t i = 0; i < streams_.size(); i++) {
+        Stream& stream = streams_[i];
+        stream.pipeline = pipelines_.acquire(config_);
+        // the audio history is long enough for the largest frame the plan analyses
+        stream.window.assign(plan_.history_size, 0);
+        stream.index = i;
+        if (streams_.size() > 1) {
+            stream.frame.reset(new FeatureFrame(stream_schema));
+        }
     }
+    interleaved_.assign(channels_ > 1 ? plan_.history_size * channels_ : 0, 0);
 
-    if (subscription_["spectral_contrast"]) {
-        spectrum_->output("spectrum") >> spectral_contrast_->input("spectrum");
-        spectral_contrast_->output("spectralContrast") >> PC(sfx_pool_, "spectral_contrast");
-        spectral_contrast_->output("spectralValley") >> PC(sfx_pool_, "spectral_valley");
+    // one frame being filled and one being sent is the steady state, more are only allocated
+    // when the output stage falls behind
+    frames_.clear();
+    for (int i = 0; i < 2; i++) {
+        frames_.push_back(std::make_shared<FeatureFrame>(schema_));
     }
 
-    if (subscription_["spectral_complexity"]) {
-        spectrum_->output("spectrum") >> spectral_complexity_->input("spectrum");
-        spectral_complexity_->output("spectralComplexity") >> PC(sfx_pool_, "spectral_complexity");
-    }
+    // room for a second of audio, so that short analysis stalls do not drop samples
+    samples_.allocate(std::max<size_t>(sample_rate_, plan_.history_size * 2) * channels_);
+    marks_.allocate(MAX_PENDING_FRAMES);
+    dropped_samples_ = 0;
+    next_sequence_ = 0;
+    buffered_ = 0;
+    consumed_ = 0;
+    last_mark_ = FrameMark();
+    last_frame_ = std::chrono::system_clock::now().time_since_epoch().count();
 
-    if (subscription_["chroma"]) {
-        windowing_->output("frame") >> chroma_->input("frame");
-        chroma_->output("chromagram") >> PC(sfx_pool_, "chroma");
-    }
+    metrics_->active = true;
+    metrics_->queue_depth = 0;
 
-    if (subscription_["onset"]) {
-        spectrum_->output("spectrum") >> triangle_bands_->input("spectrum");
-        triangle_bands_->output("bands") >> super_flux_novelty_->input("bands");
-        super_flux_novelty_->output("differences") >> super_flux_peaks_->input("novelty");
-        super_flux_peaks_->output("peaks") >> PC(onset_pool_, "onset");
+    // frames may be buffered from the networking thread as soon as the session is busy
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        busy_ = true;
     }
 
-    aggregator_->input("input").set(sfx_pool_);
-    aggregator_->output("output").set(aggr_pool_);
-    network_ = new scheduler::Network(gen_);
-
-    last_frame_ = std::chrono::system_clock::now();
     timer_thread_ = std::thread(&Analyzer::timer, this);
     analyzer_thread_ = std::thread(&Analyzer::analyze, this);
 }
 
-void Analyzer::clear() {
-    network_->reset();
-    frame_cutter_->reset();
-    std::fill(window_.begin(), window_.end(), 0);
-    gen_->setVector(&window_);
-    aggr_pool_.clear();
-    sfx_pool_.clear();
-}
-
 void Analyzer::end() {
     // busy may or may not already be false - make sure so that the analyzer thread knows to exit
     {
         std::lock_guard<std::mutex> guard(mutex_);
         busy_ = false;
     }
+    wake();
+
+    // the session may already have been ended by the timer thread
+    if (!analyzer_thread_.joinable()) {
+        return;
+    }
 
     analyzer_thread_.join();
+    metrics_->active = false;
+    metrics_->buffered_samples = 0;
 
-    {
-        std::lock_guard<std::mutex> guard(mutex_);
-        clear();
-        busy_ = false;
+    // the pipelines are reset and kept for the next session with the same config
+    for (auto& stream : streams_) {
+        pipelines_.release(config_, std::move(stream.pipeline));
     }
 }
 
@@ -270,24 +154,29 @@ void Analyzer::end_session() {
         std::lock_guard<std::mutex> guard(mutex_);
         busy_ = false;
     }
+    timer_cv_.notify_all();
+
+    if (timer_thread_.joinable()) {
+        timer_thread_.join();
+    }
 
-    timer_thread_.join();
     end();
 }
 
 void Analyzer::timer() {
     while (true) {
-        std::this_thread::sleep_for(std::chrono::seconds(5));
-
         bool analyzing = false;
         bool timedout = false;
         bool busy = false;
 
-        // safely read from the analyzer's state
+        // safely read from the analyzer's state, waking early if the session is ended
         {
-            std::lock_guard<std::mutex> guard(mutex_);
+            std::unique_lock<std::mutex> lock(mutex_);
+            timer_cv_.wait_for(lock, std::chrono::seconds(5), [this]() { return !busy_; });
             auto now = std::chrono::system_clock::now();
-            std::chrono::duration<double> elapsed_seconds = now - last_frame_;
+            std::chrono::system_clock::time_point last_frame(
+                std::chrono::system_clock::duration(last_frame_.load()));
+            std::chrono::duration<double> elapsed_seconds = now - last_frame;
             analyzing = analyzing_;
             timedout = elapsed_seconds.count() > 5;
             busy = busy_;
@@ -306,132 +195,212 @@ void Analyzer::timer() {
     }
 }
 
-void Analyzer::buffer_frame(std::vector<Real> frame) {
-    std::lock_guard<std::mutex> guard(mutex_);
-    last_frame_ = std::chrono::system_clock::now();
-    frames_.push_back(frame);
-    if (frames_.size() > memory_) {
-        frames_.erase(frames_.begin());
+// Wakes the analyzer thread. Taking wake_mutex_ orders the notification after any state the
+// analyzer thread checks before it waits, so the wakeup cannot be lost.
+void Analyzer::wake() {
+    { std::lock_guard<std::mutex> guard(wake_mutex_); }
+    wake_cv_.notify_all();
+}
+
+void Analyzer::buffer_frame(const std::vector<Real>& frame, long sequence) {
+    const Real* values = frame.data();
+    buffer_samples(frame.size(), [values](float* out, size_t first, size_t n) {
+        std::copy(values + first, values + first + n, out);
+    }, sequence);
+}
+
+void Analyzer::buffer_pcm(const char* data, size_t sample_count, SampleFormat format,
+                          uint32_t sequence) {
+    buffer_samples(sample_count, [data, format](float* out, size_t first, size_t n) {
+        decode_samples(data + first * sample_size(format), n, format, out);
+    }, sequence);
+}
+
+// Records where a buffered frame ends, so that the hops analysing it can echo its sequence
+void Analyzer::mark_frame(size_t sample_count, long sequence, bool written) {
+    uint32_t frame_sequence = sequence >= 0 ? static_cast<uint32_t>(sequence) : next_sequence_;
+    next_sequence_ = frame_sequence + 1;
+    metrics_->frames_received++;
+
+    if (!written) {
+        dropped_samples_ += sample_count;
+        metrics_->samples_dropped += sample_count;
+        return;
     }
-    new_frame_ = true;
+
+    buffered_ += sample_count / channels_;
+    FrameMark mark = {frame_sequence, buffered_, now_us()};
+    // a full ring only loses the frame's sequence, never its audio
+    marks_.write(&mark, 1);
 }
 
-void Analyzer::aggregate() {
-    aggregator_->compute();
-
-    // rescaling values afterward
-    aggr_pool_.set("centroid.mean", aggr_pool_.value<Real>("centroid.mean") * sample_rate_ / 2);
-    aggr_pool_.set("centroid.var",
-                  aggr_pool_.value<Real>("centroid.var") * sample_rate_ * sample_rate_ / 4);
-
-    // normalize mfcc
-    if (aggr_pool_.contains<std::vector<Real>>("mfcc.mean")) {
-        std::vector<Real> v = aggr_pool_.value<std::vector<Real>>("mfcc.mean");
-        float factor = (window_size_);
-        aggr_pool_.remove("mfcc.mean");
-        for (auto& e : v) {
-            aggr_pool_.add("mfcc.mean", e * 1.0 / factor);
-        }
+// Forgets the frames that are entirely in the history, keeping the newest of them
+void Analyzer::pop_marks() {
+    FrameMark mark;
+    while (marks_.peek(mark) && mark.end <= consumed_) {
+        marks_.skip(1);
+        last_mark_ = mark;
+    }
+}
 
-        v = aggr_pool_.value<std::vector<Real>>("mfcc.var");
-        factor *= factor;
-        aggr_pool_.remove("mfcc.var");
-        for (auto& e : v) {
-            aggr_pool_.add("mfcc.var", e * 1.0 / factor);
-        }
-    } else if (sfx_pool_.contains<std::vector<std::vector<Real>>>("mfcc")) {
-        // only one frame was aquired  ( no aggregation but we still want output!)
-        std::vector<Real> v = sfx_pool_.value<std::vector<std::vector<Real>>>("mfcc")[0];
-        float factor = (window_size_);
-        aggr_pool_.removeNamespace("mfcc");
-        aggr_pool_.remove("mfcc");
-        for (auto& e : v) {
-            aggr_pool_.add("mfcc.mean", e * 1.0 / factor);
-            aggr_pool_.add("mfcc.var", 0);
-        }
+// Whether the skip policy drops the waiting audio: more than one whole hop waits and the oldest
+// frame has waited longer than the deadline
+bool Analyzer::behind(size_t hops) {
+    if (backlog_policy_ != BACKLOG_SKIP || hops <= 1) {
+        return false;
+    }
+
+    pop_marks();
+    FrameMark oldest;
+    if (!marks_.peek(oldest)) {
+        return deadline_us_ == 0;
     }
+    return now_us() - oldest.received_at > deadline_us_;
 }
 
-Features Analyzer::extract_features(const Pool& p) {
-    Features vectors_out;
+// Moves the count oldest buffered samples of every channel into the sliding audio histories,
+// newest samples last
+size_t Analyzer::drain(size_t count) {
+    size_t history_size = plan_.history_size;
+    if (count > history_size) {
+        samples_.skip((count - history_size) * channels_);
+        count = history_size;
+    }
 
-    Features vectors_in = p.getRealPool();
-    for (auto const& iter : vectors_in) {
-        std::string k = iter.first;
-        std::vector<Real> v = (iter.second);
-        vectors_out[k] = v;
+    size_t first = history_size - count;
+    for (auto& stream : streams_) {
+        std::copy(stream.window.begin() + count, stream.window.end(), stream.window.begin());
     }
 
-    Features reals_in = p.getSingleVectorRealPool();
-    for (auto const& iter : reals_in) {
-        std::string k = iter.first;
-        std::vector<Real> v = iter.second;
-        vectors_out[k] = v;
+    // mono audio goes straight into the history
+    if (channels_ == 1) {
+        return samples_.read(streams_[0].window.data() + first, count);
     }
 
-    auto reals2_in = p.getSingleRealPool();
-    for (auto const& iter : reals2_in) {
-        std::string k = iter.first;
-        std::vector<Real> v = std::vector<Real>(1, iter.second);
-        vectors_out[k] = v;
+    size_t read = samples_.read(interleaved_.data(), count * channels_) / channels_;
+    for (unsigned int channel = 0; channel < channels_; channel++) {
+        Real* window = streams_[channel].window.data() + first;
+        const Real* in = interleaved_.data() + channel;
+        for (size_t i = 0; i < read; i++) {
+            window[i] = in[i * channels_];
+        }
     }
+    mix(first);
+    return read;
+}
 
-    return vectors_out;
+// Writes the mixes of the channels' histories from first on
+void Analyzer::mix(size_t first) {
+    size_t history_size = plan_.history_size;
+    if (mix_ == MIX_SUM) {
+        Real* sum = streams_[channels_].window.data();
+        Real scale = Real(1) / channels_;
+        std::fill(sum + first, sum + history_size, Real(0));
+        for (unsigned int channel = 0; channel < channels_; channel++) {
+            const Real* in = streams_[channel].window.data();
+            for (size_t i = first; i < history_size; i++) {
+                sum[i] += in[i] * scale;
+            }
+        }
+    } else if (mix_ == MIX_MID_SIDE) {
+        const Real* left = streams_[0].window.data();
+        const Real* right = streams_[1].window.data();
+        Real* mid = streams_[2].window.data();
+        Real* side = streams_[3].window.data();
+        for (size_t i = first; i < history_size; i++) {
+            mid[i] = (left[i] + right[i]) * Real(0.5);
+            side[i] = (left[i] - right[i]) * Real(0.5);
+        }
+    }
 }
 
-Features Analyzer::get_features() {
-    if (sfx_pool_.getRealPool().size() < 1) {
-        return std::map<std::string, std::vector<Real>>();
+// Analyses one hop made of the count oldest buffered samples
+void Analyzer::step(size_t count, size_t skipped) {
+    unsigned long long allocations = thread_allocations();
+    {
+        ScopedTimer timer(drain_timer_);
+        drain(count);
     }
+    consumed_ += count;
+    pop_marks();
 
-    aggregate();
+    auto frame = next_frame();
+    {
+        ScopedTimer timer(analysis_timer_);
+        for (auto& stream : streams_) {
+            if (!stream.frame) {
+                stream.pipeline->process(stream.window, *frame);
+                continue;
+            }
+            stream.pipeline->process(stream.window, *stream.frame);
+            frame->write_stream(*stream.frame, stream.index);
+        }
+    }
 
-    auto features = extract_features(aggr_pool_);
+    FrameOrigin& origin = frame->origin();
+    origin.frame_sequence = last_mark_.sequence;
+    origin.received_at = last_mark_.received_at;
+    origin.analysed_at = now_us();
+    origin.skipped = skipped;
 
-    if (subscription_["onset"]) {
-        auto onset = extract_features(onset_pool_);
-        features["onset"] = onset["onset"];
-    }
+    metrics_->hops_analysed++;
+    metrics_->samples_skipped += skipped;
+    frame->hand_off();
+    feature_handler_(conn_, frame_count_++, frame);
+    metrics_->hop_allocations += thread_allocations() - allocations;
+}
 
-    clear();
+// Returns a frame the output stage is done with
+std::shared_ptr<FeatureFrame> Analyzer::next_frame() {
+    for (auto const& frame : frames_) {
+        if (!frame->in_flight()) {
+            return frame;
+        }
+    }
 
-    return features;
+    frames_.push_back(std::make_shared<FeatureFrame>(schema_));
+    return frames_.back();
 }
 
 void Analyzer::analyze() {
-    while (true) {
-        bool new_frame = false;
+    while (busy_) {
+        // sleep until a whole hop has arrived or the session ends
+        {
+            std::unique_lock<std::mutex> lock(wake_mutex_);
+            wake_cv_.wait(lock, [this]() {
+                return samples_.size() / channels_ >= hop_size_ || !busy_;
+            });
+        }
+
+        // only whole hops are analysed, a partial one waits in the ring for the rest of its
+        // samples. Resampled frames rarely hold a whole number of hops, and analysing their
+        // remainder as a hop would make the hop rate drift from the one the pipeline assumes.
+        size_t hops = samples_.size() / channels_ / hop_size_;
+        if (hops == 0) {
+            continue;
+        }
+
         {
             std::lock_guard<std::mutex> guard(mutex_);
-            new_frame = new_frame_;
-            std::fill(window_.begin(), window_.end(), 0);
-            for (int f = 0; f < frames_.size(); f++) {
-                for (int i = 0; i < hop_size_; i++) {
-                    window_[f * hop_size_ + i] = frames_[f][i];
-                }
-            }
-            gen_->setVector(&window_);
-            if (new_frame) {
-                analyzing_ = true;
-            }
+            analyzing_ = true;
         }
 
-        if (new_frame) {
-            gen_->process();
-            network_->run();
-            auto features = get_features();
-            feature_handler_(conn_, features);
+        if (behind(hops)) {
+            // every whole hop but the newest is skipped, the history still fills with the
+            // newest audio
+            size_t skipped = (hops - 1) * hop_size_;
+            step(skipped + hop_size_, skipped);
         } else {
-            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            // every waiting hop in order
+            for (size_t hop = 0; hop < hops && busy_; hop++) {
+                step(hop_size_, 0);
+            }
         }
+        metrics_->buffered_samples = samples_.size();
 
         {
             std::lock_guard<std::mutex> guard(mutex_);
             analyzing_ = false;
-            
-            if (!busy_) {
-                break;
-            }
         }
     }
 }
@@ -2,10 +2,13 @@
 #define _ANALYZER
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <ctime>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <thread>
 #include <vector>
@@ -17,32 +20,53 @@
 #include <websocketpp/config/asio_no_tls.hpp>
 #include <websocketpp/server.hpp>
 
-#include <essentia/algorithmfactory.h>
-#include <essentia/essentiamath.h>
-#include <essentia/pool.h>
-#include <essentia/streaming/algorithms/ringbufferinput.h>
-#include <essentia/streaming/algorithms/vectorinput.h>
-#include <essentia/streaming/algorithms/vectoroutput.h>
-#include <essentia/streaming/streamingalgorithm.h>
-
-#include <essentia/scheduler/network.h>
-#include <essentia/streaming/algorithms/poolstorage.h>
-
+#include "BinaryProtocol.hpp"
+#include "FeatureFrame.hpp"
+#include "FeatureOutput.hpp"
+#include "FeatureSchema.hpp"
+#include "Features.hpp"
+#include "Metrics.hpp"
+#include "Pipeline.hpp"
+#include "PipelineCache.hpp"
+#include "Resampler.hpp"
+#include "SampleRing.hpp"
 #include "WebsocketServer.hpp"
 
 using namespace essentia;
-using namespace streaming;
 
-#define NOVELTY_MULT 1000000
+// What the analyzer does with audio that arrived while it was busy
+enum BacklogPolicy {
+    // once the oldest waiting frame is older than the deadline, everything but the newest audio
+    // is skipped and analysed as a single hop
+    BACKLOG_SKIP,
+    // every hop is analysed in order, however late
+    BACKLOG_CATCH_UP
+};
 
-typedef std::map<std::string, bool> FeatureSubscription;
-typedef std::map<std::string, std::vector<Real>> Features;
+// Signals a multi-channel session analyses besides its channels
+enum ChannelMix {
+    MIX_NONE,
+    // the average of all channels
+    MIX_SUM,
+    // (left + right) / 2 and (left - right) / 2, for two channels
+    MIX_MID_SIDE
+};
+
+// The sequence of a buffered frame, where it ends in the session's audio and when it arrived
+struct FrameMark {
+    uint32_t sequence;
+    unsigned long long end;
+    uint64_t received_at;
+};
 
 class Analyzer {
 public:
-    Analyzer();
+    // Pipelines are checked out of the cache when a session starts and returned when it ends
+    Analyzer(unsigned int id, PipelineCache& pipelines);
     ~Analyzer();
 
+    unsigned int id() const { return id_; }
+
     bool is_busy();
 
     void start_session(ClientConnection conn, unsigned int sample_rate, unsigned int hop_size,
@@ -52,82 +76,203 @@ public:
 
     void process_frame(std::vector<float> frame);
 
-    void buffer_frame(std::vector<float> frame);
+    // Frames are written to a lock-free single-producer ring buffer, so for a given session they
+    // must only be buffered from one thread at a time (the connection's networking thread).
+    // Frames without a sequence (negative) follow the previous one. The samples of multi-channel
+    // sessions are interleaved, frames that do not hold a whole number of them are dropped.
+    void buffer_frame(const std::vector<float>& frame, long sequence = -1);
+
+    // Decodes sample_count little-endian PCM samples directly into the ring buffer
+    void buffer_pcm(const char* data, size_t sample_count, SampleFormat format,
+                    uint32_t sequence);
+
+    // Writes a frame of sample_count samples produced by writer(float* out, size_t first,
+    // size_t n) directly into the ring buffer, see SpscRing::write
+    template <typename Writer>
+    void buffer_samples(size_t sample_count, Writer writer, long sequence = -1) {
+        if (!busy_) {
+            return;
+        }
+
+        last_frame_ = std::chrono::system_clock::now().time_since_epoch().count();
+        if (sample_count % channels_ != 0) {
+            mark_frame(sample_count, sequence, false);
+            return;
+        }
+
+        // audio at another rate than the analysis rate is converted before it is buffered
+        bool written;
+        if (resampler_) {
+            writer(resampler_->input(sample_count), 0, sample_count);
+            sample_count = resampler_->process(sample_count / channels_) * channels_;
+            const float* resampled = resampler_->output();
+            written = samples_.write(sample_count, [resampled](float* out, size_t first, size_t n) {
+                std::copy(resampled + first, resampled + first + n, out);
+            });
+        } else {
+            written = samples_.write(sample_count, writer);
+        }
+        mark_frame(sample_count, sequence, written);
+        wake();
+    }
 
     template <typename FeaturesCallback> void handle_features(FeaturesCallback handler) {
         feature_handler_ = handler;
     }
 
-    Features get_features();
+    // Number of interleaved channels the session's audio has, and the mixes of them analysed
+    // besides each channel. Mid/side needs two channels. Set before starting.
+    void set_channels(unsigned int channels, ChannelMix mix) {
+        channels_ = std::max(1u, channels);
+        mix_ = mix;
+        if (channels_ == 1 || (mix == MIX_MID_SIDE && channels_ != 2)) {
+            mix_ = MIX_NONE;
+        }
+    }
+    unsigned int channels() const { return channels_; }
+
+    // Sample rate the session's audio is analysed at, 0 for the rate of the client's audio.
+    // Audio at another rate is resampled as it is buffered, so that sessions from clients with
+    // different rates share one pipeline configuration. Set before starting.
+    void set_analysis_rate(unsigned int analysis_rate) { analysis_rate_ = analysis_rate; }
+
+    // The rate hops are analysed at and the hop size at that rate, valid once started. Sample
+    // counts in the features, such as skipped samples and onset offsets, are at this rate.
+    unsigned int sample_rate() const { return sample_rate_; }
+    unsigned int hop_size() const { return hop_size_; }
+
+    // Names of the signals analysed, which prefix their features unless the session only
+    // analyses a mono channel: "ch0", "ch1", ... then "sum" or "mid" and "side". Valid once the
+    // session has started.
+    const std::vector<std::string>& streams() const { return stream_names_; }
+
+    // Layout of the values produced on every hop, valid once the session has started
+    const FeatureSchema& schema() const { return *schema_; }
+
+    // The nodes built for the subscription and their estimated cost, valid once started
+    const FeaturePlan& plan() const { return plan_; }
+
+    // Whether features are sent as packed float32 values described by schema() instead of JSON
+    void set_binary_output(bool binary_output) { binary_output_ = binary_output; }
+    bool binary_output() const { return binary_output_; }
+
+    // Whether hops are analysed incrementally by a StreamingPipeline that keeps its state across
+    // hops, instead of re-running a NetworkPipeline over the whole memory window. Set before
+    // starting.
+    void set_streaming(bool streaming) { streaming_ = streaming; }
+    bool streaming() const { return streaming_; }
+
+    // Delivers the session's features to its client. Set on the main event loop and read by the
+    // analyzer thread's feature handler.
+    void set_output(std::shared_ptr<FeatureOutput> output) { std::atomic_store(&output_, output); }
+    std::shared_ptr<FeatureOutput> output() const { return std::atomic_load(&output_); }
+
+    // Mask of the stats aggregated features are reported as, and the number of hops they run
+    // over in streaming mode (0 for memory). Set before starting.
+    void set_stats(unsigned int stats) { stats_ = stats; }
+    void set_horizon(unsigned int horizon) { horizon_ = horizon; }
+
+    // How audio that waited while the analyzer was busy is analysed, and how long it may wait
+    // under BACKLOG_SKIP (0 skips to the newest audio whenever more than a hop is waiting). Set
+    // before starting.
+    void set_backlog(BacklogPolicy policy, unsigned int deadline_ms) {
+        backlog_policy_ = policy;
+        deadline_us_ = deadline_ms * 1000ULL;
+    }
+
+    // Counters of the sessions this analyzer serves, exported by Metrics. Shared with the
+    // session's output, which may outlive the analyzer while its last sends complete.
+    std::shared_ptr<SessionMetrics> metrics() const { return metrics_; }
 
 private:
-    void configure_subscription(std::vector<std::string> features);
+    // One analysed signal: a channel or a mix of them
+    struct Stream {
+        std::unique_ptr<Pipeline> pipeline;
+        // the newest plan_.history_size samples, the frames of every resolution are cut from
+        // its end
+        std::vector<Real> window;
+        // the features of the hop, copied into the session's frame as its index-th stream.
+        // Sessions with a single stream have none, their pipeline writes into the session's
+        // frame directly.
+        std::unique_ptr<FeatureFrame> frame;
+        size_t index;
+    };
+
     void timer();
-    void clear();
     void end();
-    void aggregate();
-    Features extract_features(const Pool& p);
     void analyze();
+    void wake();
+    void mark_frame(size_t sample_count, long sequence, bool written);
+    void pop_marks();
+    bool behind(size_t hops);
+    void step(size_t count, size_t skipped);
+    size_t drain(size_t count);
+    void mix(size_t first);
+    std::shared_ptr<FeatureFrame> next_frame();
 
-    bool busy_ = false;
+    unsigned int id_;
+    std::atomic<bool> busy_{false};
     bool analyzing_ = false;
     bool ending_ = false;
-    bool new_frame_ = false;
     unsigned int sample_rate_;
     unsigned int hop_size_;
     unsigned int memory_;
     unsigned int window_size_;
     unsigned int frame_count_;
 
-    FeatureSubscription subscription_;
+    FeaturePlan plan_;
+    std::shared_ptr<const FeatureSchema> schema_;
+    bool binary_output_ = false;
+    bool streaming_ = false;
+    unsigned int channels_ = 1;
+    ChannelMix mix_ = MIX_NONE;
+    unsigned int analysis_rate_ = 0;
+    unsigned int stats_ = DEFAULT_STATS;
+    unsigned int horizon_ = 0;
+    std::shared_ptr<FeatureOutput> output_;
+    std::shared_ptr<SessionMetrics> metrics_;
+    Histogram* drain_timer_;
+    Histogram* analysis_timer_;
 
-    float combine_ms_;
+    BacklogPolicy backlog_policy_ = BACKLOG_SKIP;
+    uint64_t deadline_us_ = 0;
 
-    std::vector<std::vector<Real>> frames_;
-    std::vector<Real> window_;
+    // written by the thread receiving frames, read by the analyzer thread
+    SampleRing samples_;
+    SpscRing<FrameMark> marks_;
+    // only touched by the thread receiving frames, for sessions whose audio is resampled
+    std::unique_ptr<Resampler> resampler_;
+    std::atomic<unsigned long> dropped_samples_{0};
+    // only touched by the thread receiving frames, buffered_ and consumed_ count samples per
+    // channel
+    uint32_t next_sequence_;
+    unsigned long long buffered_;
+    // only touched by the analyzer thread
+    unsigned long long consumed_;
+    FrameMark last_mark_;
     std::vector<std::string> features_;
 
-    /// ESSENTIA
-    /// algos
-    streaming::Algorithm* frame_cutter_;
-    streaming::Algorithm* windowing_;
-    streaming::Algorithm* rms_;
-    streaming::Algorithm* energy_;
-    streaming::Algorithm* centroid_;
-    streaming::Algorithm* loudness_;
-    streaming::Algorithm* spectrum_;
-    streaming::Algorithm* flatness_;
-    streaming::Algorithm* yin_;
-    streaming::Algorithm* mfcc_;
-    streaming::Algorithm* hpcp_;
-    streaming::Algorithm* spectral_peaks_;
-    streaming::Algorithm* dissonance_;
-    streaming::Algorithm* key_;
-    streaming::Algorithm* tristimulus_;
-    streaming::Algorithm* spectral_contrast_;
-    streaming::Algorithm* spectral_complexity_;
-    streaming::Algorithm* chroma_;
-    streaming::Algorithm* triangle_bands_;
-    streaming::Algorithm* super_flux_novelty_;
-    streaming::Algorithm* super_flux_peaks_;
-    //// IO
-    VectorInput<Real>* gen_;
-
-    essentia::standard::Algorithm* aggregator_;
-
-    scheduler::Network* network_ = NULL;
-
-    Pool aggr_pool_;
-    Pool sfx_pool_;
-    Pool onset_pool_;
+    PipelineCache& pipelines_;
+    PipelineConfig config_;
+    // every channel, then the mixes, all analysed by pipelines built from config_
+    std::vector<Stream> streams_;
+    std::vector<std::string> stream_names_;
+    // interleaved samples read from the ring buffer of a multi-channel session
+    std::vector<Real> interleaved_;
+    // laid out when the session starts and reused, only touched by the analyzer thread
+    std::vector<std::shared_ptr<FeatureFrame>> frames_;
 
     std::thread timer_thread_;
     std::thread analyzer_thread_;
-    std::chrono::time_point<std::chrono::system_clock> last_frame_;
+    std::atomic<std::chrono::system_clock::rep> last_frame_{0};
     std::mutex mutex_;
+    std::condition_variable timer_cv_;
+    std::mutex wake_mutex_;
+    std::condition_variable wake_cv_;
 
     ClientConnection conn_;
-    std::function<void(ClientConnection, Features)> feature_handler_;
+    std::function<void(ClientConnection, unsigned int, std::shared_ptr<FeatureFrame>)>
+        feature_handler_;
 };
 
 #endif
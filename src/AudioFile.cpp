@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "AudioFile.hpp"
+
+#define WAVE_FORMAT_PCM 0x0001
+#define WAVE_FORMAT_IEEE_FLOAT 0x0003
+#define WAVE_FORMAT_EXTENSIBLE 0xfffe
+
+static uint16_t read_u16(const char* data) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+static uint32_t read_u32(const char* data) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+AudioFile::AudioFile()
+    : data_(NULL), size_(0), samples_(NULL), frames_(0), format_(SAMPLE_FORMAT_FLOAT32),
+      sample_rate_(0), channels_(1) {}
+
+AudioFile::~AudioFile() { unmap(); }
+
+bool AudioFile::fail(const std::string& error) {
+    error_ = error;
+    unmap();
+    return false;
+}
+
+bool AudioFile::map(const std::string& path) {
+    unmap();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error_ = "cannot open " + path + ": " + std::strerror(errno);
+        return false;
+    }
+
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || info.st_size == 0) {
+        ::close(fd);
+        error_ = path + " is empty or cannot be read";
+        return false;
+    }
+
+    void* data = ::mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        error_ = "cannot map " + path + ": " + std::strerror(errno);
+        return false;
+    }
+
+    // the file is read front to back, by several threads at once
+    ::madvise(data, info.st_size, MADV_SEQUENTIAL);
+
+    data_ = static_cast<const char*>(data);
+    size_ = info.st_size;
+    return true;
+}
+
+void AudioFile::unmap() {
+    if (data_ != NULL) {
+        ::munmap(const_cast<char*>(data_), size_);
+    }
+    data_ = NULL;
+    samples_ = NULL;
+    size_ = 0;
+    frames_ = 0;
+}
+
+bool AudioFile::open_raw(const std::string& path, SampleFormat format, unsigned int sample_rate,
+                         unsigned int channels) {
+    if (sample_size(format) == 0 || sample_rate == 0 || channels == 0) {
+        error_ = "invalid raw format";
+        return false;
+    }
+
+    if (!map(path)) {
+        return false;
+    }
+
+    samples_ = data_;
+    format_ = format;
+    sample_rate_ = sample_rate;
+    channels_ = channels;
+    frames_ = size_ / (sample_size(format) * channels);
+    return true;
+}
+
+// Walks the RIFF chunks for "fmt " and "data", the other chunks are skipped
+bool AudioFile::open_wav(const std::string& path) {
+    if (!map(path)) {
+        return false;
+    }
+
+    if (size_ < 12 || std::memcmp(data_, "RIFF", 4) != 0 ||
+        std::memcmp(data_ + 8, "WAVE", 4) != 0) {
+        return fail(path + " is not a WAV file");
+    }
+
+    bool has_format = false;
+    size_t offset = 12;
+    while (offset + 8 <= size_) {
+        const char* chunk = data_ + offset;
+        size_t chunk_size = read_u32(chunk + 4);
+        const char* body = chunk + 8;
+        size_t available = std::min(chunk_size, size_ - offset - 8);
+
+        if (std::memcmp(chunk, "fmt ", 4) == 0 && available >= 16) {
+            uint16_t tag = read_u16(body);
+            channels_ = read_u16(body + 2);
+            sample_rate_ = read_u32(body + 4);
+            uint16_t bits = read_u16(body + 14);
+
+            // the sub format GUID starts with the format tag
+            if (tag == WAVE_FORMAT_EXTENSIBLE && available >= 26) {
+                tag = read_u16(body + 24);
+            }
+
+            if (tag == WAVE_FORMAT_PCM && bits == 16) {
+                format_ = SAMPLE_FORMAT_INT16;
+            } else if (tag == WAVE_FORMAT_IEEE_FLOAT && bits == 32) {
+                format_ = SAMPLE_FORMAT_FLOAT32;
+            } else {
+                return fail(path + ": only 16 bit PCM and 32 bit float WAV files are supported");
+            }
+
+            if (channels_ == 0 || sample_rate_ == 0) {
+                return fail(path + ": invalid fmt chunk");
+            }
+            has_format = true;
+        } else if (std::memcmp(chunk, "data", 4) == 0) {
+            if (!has_format) {
+                return fail(path + ": data chunk before fmt chunk");
+            }
+
+            // a truncated file is read up to its last complete sample
+            samples_ = body;
+            frames_ = available / (sample_size(format_) * channels_);
+            return true;
+        }
+
+        // chunks are padded to an even size
+        offset += 8 + chunk_size + (chunk_size & 1);
+    }
+
+    return fail(path + ": no data chunk");
+}
+
+void AudioFile::read(long first, size_t count, float* out) const {
+    long end = first + static_cast<long>(count);
+    long from = std::max<long>(first, 0);
+    long to = std::min<long>(end, frames_);
+
+    if (from >= to) {
+        std::fill(out, out + count, 0.0f);
+        return;
+    }
+
+    std::fill(out, out + (from - first), 0.0f);
+    std::fill(out + (to - first), out + count, 0.0f);
+
+    size_t frame_bytes = sample_size(format_) * channels_;
+    const char* data = samples_ + from * frame_bytes;
+    float* samples = out + (from - first);
+    size_t n = to - from;
+
+    if (channels_ == 1) {
+        decode_samples(data, n, format_, samples);
+        return;
+    }
+
+    // mixed down one frame at a time, the live path only analyses mono audio
+    std::vector<float> frame(channels_);
+    float scale = 1.0f / channels_;
+    for (size_t i = 0; i < n; i++) {
+        decode_samples(data + i * frame_bytes, channels_, format_, frame.data());
+        float sum = 0;
+        for (auto sample : frame) {
+            sum += sample;
+        }
+        samples[i] = sum * scale;
+    }
+}
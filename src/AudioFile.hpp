@@ -0,0 +1,54 @@
+#ifndef _AUDIO_FILE
+#define _AUDIO_FILE
+
+#include <cstddef>
+#include <string>
+
+#include "BinaryProtocol.hpp"
+
+// A WAV or raw PCM file mapped into memory, read as mono samples. Reads only touch the pages they
+// need, so any number of threads can decode different parts of a large file at once.
+class AudioFile {
+public:
+    AudioFile();
+    ~AudioFile();
+
+    AudioFile(const AudioFile&) = delete;
+    AudioFile& operator=(const AudioFile&) = delete;
+
+    // Maps a 16 bit integer or 32 bit float WAV file. Returns false and sets error() on failure.
+    bool open_wav(const std::string& path);
+
+    // Maps headerless little-endian interleaved samples in the given format
+    bool open_raw(const std::string& path, SampleFormat format, unsigned int sample_rate,
+                  unsigned int channels);
+
+    const std::string& error() const { return error_; }
+
+    unsigned int sample_rate() const { return sample_rate_; }
+    unsigned int channels() const { return channels_; }
+
+    // Samples per channel
+    size_t frames() const { return frames_; }
+
+    // Writes count samples starting at frame first into out, averaging the channels. Samples
+    // before the start or past the end of the file are 0.
+    void read(long first, size_t count, float* out) const;
+
+private:
+    bool map(const std::string& path);
+    void unmap();
+    bool fail(const std::string& error);
+
+    const char* data_;
+    size_t size_;
+    // first sample of the PCM data
+    const char* samples_;
+    size_t frames_;
+    SampleFormat format_;
+    unsigned int sample_rate_;
+    unsigned int channels_;
+    std::string error_;
+};
+
+#endif
@@ -0,0 +1,283 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include "BatchAnalyzer.hpp"
+#include "FeatureFrame.hpp"
+
+// hops per chunk, about 6s of audio at 44.1kHz with a hop of 512
+#define CHUNK_HOPS 512
+
+static size_t round_up(size_t value, size_t multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+BatchAnalyzer::BatchAnalyzer(const PipelineConfig& config, unsigned int threads)
+    : config_(config),
+      threads_(threads != 0 ? threads : std::max(1u, std::thread::hardware_concurrency())),
+      plan_(FeatureGraph::instance().plan(config)),
+      schema_(std::make_shared<FeatureSchema>(plan_, config)), pipelines_(threads_) {
+    unsigned int interval = 1;
+    for (auto const& planned : plan_.nodes) {
+        interval = std::max(interval, planned.interval);
+    }
+
+    // window pipelines only see the current window, so their chunks need no warm-up
+    size_t warmup = 0;
+    if (config.streaming) {
+        size_t horizon = config.horizon != 0 ? config.horizon : config.memory;
+        warmup = round_up(plan_.history_size, config.hop_size) / config.hop_size + 4 * horizon;
+    }
+
+    warmup_hops_ = round_up(warmup, interval);
+    // warm-up adds at most a quarter to the work of a chunk
+    chunk_hops_ = round_up(std::max<size_t>(CHUNK_HOPS, 4 * warmup_hops_), interval);
+}
+
+size_t BatchAnalyzer::hops(size_t frames) const {
+    return round_up(frames, config_.hop_size) / config_.hop_size;
+}
+
+// Feeds the chunk's hops to the pipeline with the same sliding history the Analyzer keeps
+void BatchAnalyzer::analyze_chunk(const AudioFile& file, Pipeline& pipeline, Chunk& chunk) {
+    size_t hop_size = config_.hop_size;
+    size_t history_size = plan_.history_size;
+    size_t value_count = schema_->size();
+    size_t start = chunk.first_hop > warmup_hops_ ? chunk.first_hop - warmup_hops_ : 0;
+
+    std::vector<essentia::Real> history(history_size);
+    FeatureFrame frame(schema_);
+    chunk.values.resize((chunk.end_hop - chunk.first_hop) * value_count);
+
+    pipeline.reset();
+    for (size_t hop = start; hop < chunk.end_hop; hop++) {
+        long end = static_cast<long>((hop + 1) * hop_size);
+        if (hop == start || hop_size >= history_size) {
+            file.read(end - static_cast<long>(history_size), history_size, history.data());
+        } else {
+            std::copy(history.begin() + hop_size, history.end(), history.begin());
+            file.read(end - static_cast<long>(hop_size), hop_size,
+                      history.data() + history_size - hop_size);
+        }
+
+        pipeline.process(history, frame);
+
+        if (hop >= chunk.first_hop) {
+            std::copy(frame.data(), frame.data() + value_count,
+                      chunk.values.begin() + (hop - chunk.first_hop) * value_count);
+        }
+    }
+}
+
+size_t BatchAnalyzer::analyze(const AudioFile& file, TimelineWriter& writer) {
+    size_t total = hops(file.frames());
+    size_t count = round_up(total, chunk_hops_) / chunk_hops_;
+
+    std::vector<Chunk> chunks(count);
+    for (size_t i = 0; i < count; i++) {
+        chunks[i].first_hop = i * chunk_hops_;
+        chunks[i].end_hop = std::min(total, chunks[i].first_hop + chunk_hops_);
+        chunks[i].done = false;
+    }
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t next = 0;
+    size_t written = 0;
+    // workers stay a few chunks ahead of the writer, which bounds the memory of long files
+    size_t max_ahead = 2 * threads_;
+
+    auto work = [&]() {
+        std::unique_ptr<Pipeline> pipeline = pipelines_.acquire(config_);
+        while (true) {
+            size_t index;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&]() { return next >= count || next < written + max_ahead; });
+                index = next++;
+            }
+            if (index >= count) {
+                break;
+            }
+
+            analyze_chunk(file, *pipeline, chunks[index]);
+
+            {
+                std::lock_guard<std::mutex> guard(mutex);
+                chunks[index].done = true;
+            }
+            cv.notify_all();
+        }
+        pipelines_.release(config_, std::move(pipeline));
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < std::min<size_t>(threads_, count); i++) {
+        workers.emplace_back(work);
+    }
+
+    // chunks are written in order as soon as they are done
+    size_t value_count = schema_->size();
+    for (size_t i = 0; i < count; i++) {
+        Chunk& chunk = chunks[i];
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&chunk]() { return chunk.done; });
+        }
+
+        for (size_t hop = chunk.first_hop; hop < chunk.end_hop; hop++) {
+            writer.write(hop, chunk.values.data() + (hop - chunk.first_hop) * value_count);
+        }
+        std::vector<essentia::Real>().swap(chunk.values);
+
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            written++;
+        }
+        cv.notify_all();
+    }
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    return total;
+}
+
+static void usage() {
+    std::cerr << "usage: server analyze <input> <output> --features <f1,f2,...> [options]\n"
+                 "  --hop-size <samples>      512\n"
+                 "  --memory <hops>           4\n"
+                 "  --mode <window|streaming> window\n"
+                 "  --stats <s1,s2,...>       mean,var\n"
+                 "  --horizon <seconds>       memory hops\n"
+                 "  --format <csv|binary>     csv\n"
+                 "  --threads <count>         every core\n"
+                 "  --raw <f32|i16>           headerless input, with --sample-rate and --channels\n"
+                 "  --sample-rate <hz>\n"
+                 "  --channels <count>        1"
+              << std::endl;
+}
+
+static std::vector<std::string> split(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+int analyze_file_command(int argc, char* argv[]) {
+    if (argc < 4) {
+        usage();
+        return 1;
+    }
+
+    std::string input = argv[2];
+    std::string output = argv[3];
+
+    // every option takes a value
+    std::map<std::string, std::string> options;
+    for (int i = 4; i < argc; i += 2) {
+        std::string name = argv[i];
+        if (name.compare(0, 2, "--") != 0 || i + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        options[name.substr(2)] = argv[i + 1];
+    }
+
+    auto option = [&options](const std::string& name, const std::string& fallback) {
+        auto iter = options.find(name);
+        return iter != options.end() ? iter->second : fallback;
+    };
+
+    std::vector<std::string> features = split(option("features", ""));
+    unsigned int hop_size = std::atoi(option("hop-size", "512").c_str());
+    unsigned int memory = std::atoi(option("memory", "4").c_str());
+    if (features.empty() || hop_size == 0 || memory == 0) {
+        usage();
+        return 1;
+    }
+
+    AudioFile file;
+    std::string raw = option("raw", "");
+    bool opened;
+    if (raw.empty()) {
+        opened = file.open_wav(input);
+    } else {
+        SampleFormat format = raw == "i16" ? SAMPLE_FORMAT_INT16 : SAMPLE_FORMAT_FLOAT32;
+        opened = file.open_raw(input, format, std::atoi(option("sample-rate", "0").c_str()),
+                               std::atoi(option("channels", "1").c_str()));
+    }
+    if (!opened) {
+        std::cerr << file.error() << std::endl;
+        return 1;
+    }
+
+    unsigned int stats = 0;
+    for (auto const& stat : split(option("stats", ""))) {
+        stats |= parse_stat(stat);
+    }
+
+    unsigned int horizon = 0;
+    double horizon_seconds = std::atof(option("horizon", "0").c_str());
+    if (horizon_seconds > 0) {
+        horizon = std::lround(horizon_seconds * file.sample_rate() / hop_size);
+    }
+
+    PipelineConfig config(file.sample_rate(), hop_size, memory, features,
+                          option("mode", "window") == "streaming",
+                          stats != 0 ? stats : DEFAULT_STATS, horizon);
+
+    BatchAnalyzer analyzer(config, std::atoi(option("threads", "0").c_str()));
+    for (auto const& name : analyzer.plan().unknown) {
+        std::clog << "Unknown feature: " << name << std::endl;
+    }
+    // timelines only hold the packed values of each hop
+    for (auto const& name : analyzer.schema().labels()) {
+        std::clog << "Not written, strings are not supported: " << name << std::endl;
+    }
+    for (auto const& name : analyzer.schema().events()) {
+        std::clog << "Only the first value of each hop is written: " << name << std::endl;
+    }
+
+    std::unique_ptr<TimelineWriter> writer;
+    if (option("format", "csv") == "binary") {
+        writer.reset(new BinaryTimelineWriter());
+    } else {
+        writer.reset(new CsvTimelineWriter());
+    }
+
+    if (!writer->open(output, analyzer.schema(), config)) {
+        std::cerr << "cannot write " << output << std::endl;
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    size_t hops = analyzer.analyze(file, *writer);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    if (!writer->close()) {
+        std::cerr << "cannot write " << output << std::endl;
+        return 1;
+    }
+
+    double seconds = static_cast<double>(file.frames()) / file.sample_rate();
+    std::clog << "Analysed " << hops << " hops (" << seconds << "s of audio) in "
+              << elapsed.count() << "s, " << seconds / elapsed.count() << "x real time"
+              << std::endl;
+
+    return 0;
+}
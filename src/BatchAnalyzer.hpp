@@ -0,0 +1,62 @@
+#ifndef _BATCH_ANALYZER
+#define _BATCH_ANALYZER
+
+#include <memory>
+#include <vector>
+
+#include <essentia/types.h>
+
+#include "AudioFile.hpp"
+#include "FeatureGraph.hpp"
+#include "FeatureSchema.hpp"
+#include "Pipeline.hpp"
+#include "PipelineCache.hpp"
+#include "TimelineWriter.hpp"
+
+// Analyses a whole file offline, as fast as the cores allow. The file is cut into chunks of hops
+// that are analysed in parallel, each by its own pipeline built from the same config as a live
+// session, and every hop sees the same audio history it would have seen live.
+//
+// Streaming pipelines keep state across hops, so each chunk starts with warm-up hops that are
+// analysed but not written: enough for the longest frame and for several horizons of stats.
+// Stats with an unbounded memory (ema) can differ from a live session by a negligible amount
+// at chunk boundaries.
+class BatchAnalyzer {
+public:
+    // threads 0 uses every core
+    BatchAnalyzer(const PipelineConfig& config, unsigned int threads);
+
+    const FeaturePlan& plan() const { return plan_; }
+    const FeatureSchema& schema() const { return *schema_; }
+
+    // Hops in a file of the given length, the last one is zero padded
+    size_t hops(size_t frames) const;
+
+    // Analyses every hop of the file and hands them to the writer in order. Returns the number
+    // of hops.
+    size_t analyze(const AudioFile& file, TimelineWriter& writer);
+
+private:
+    struct Chunk {
+        size_t first_hop;
+        size_t end_hop;
+        std::vector<essentia::Real> values;
+        bool done;
+    };
+
+    void analyze_chunk(const AudioFile& file, Pipeline& pipeline, Chunk& chunk);
+
+    PipelineConfig config_;
+    unsigned int threads_;
+    FeaturePlan plan_;
+    std::shared_ptr<const FeatureSchema> schema_;
+    PipelineCache pipelines_;
+    // multiples of the longest update interval, so every chunk sees the same long frame phase
+    size_t chunk_hops_;
+    size_t warmup_hops_;
+};
+
+// `server analyze` command line entry point, returns the process exit code
+int analyze_file_command(int argc, char* argv[]);
+
+#endif
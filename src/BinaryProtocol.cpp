@@ -0,0 +1,219 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "BinaryProtocol.hpp"
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define HOST_LITTLE_ENDIAN 1
+#else
+#define HOST_LITTLE_ENDIAN 0
+#endif
+
+static uint16_t read_u16(const char* data) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+static uint32_t read_u32(const char* data) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static uint64_t read_u64(const char* data) {
+    return static_cast<uint64_t>(read_u32(data)) |
+           (static_cast<uint64_t>(read_u32(data + 4)) << 32);
+}
+
+static void write_u32(uint32_t value, char* out) {
+    unsigned char* p = reinterpret_cast<unsigned char*>(out);
+    p[0] = value & 0xff;
+    p[1] = (value >> 8) & 0xff;
+    p[2] = (value >> 16) & 0xff;
+    p[3] = (value >> 24) & 0xff;
+}
+
+static void write_u64(uint64_t value, char* out) {
+    write_u32(value & 0xffffffff, out);
+    write_u32(value >> 32, out + 4);
+}
+
+static void write_u16(uint16_t value, char* out) {
+    unsigned char* p = reinterpret_cast<unsigned char*>(out);
+    p[0] = value & 0xff;
+    p[1] = (value >> 8) & 0xff;
+}
+
+size_t sample_size(uint16_t format) {
+    switch (format) {
+    case SAMPLE_FORMAT_FLOAT32:
+        return 4;
+    case SAMPLE_FORMAT_INT16:
+        return 2;
+    default:
+        return 0;
+    }
+}
+
+bool decode_audio_frame_header(const char* data, size_t size, AudioFrameHeader& header) {
+    if (size < AUDIO_FRAME_HEADER_SIZE) {
+        return false;
+    }
+
+    header.session_id = read_u32(data);
+    header.sequence = read_u32(data + 4);
+    header.sample_count = read_u32(data + 8);
+    header.format = read_u16(data + 12);
+    header.reserved = read_u16(data + 14);
+
+    // reserved for later versions of the header, which this one cannot read
+    if (header.reserved != 0) {
+        return false;
+    }
+
+    size_t bytes_per_sample = sample_size(header.format);
+    if (bytes_per_sample == 0) {
+        return false;
+    }
+
+    return size - AUDIO_FRAME_HEADER_SIZE == header.sample_count * bytes_per_sample;
+}
+
+void encode_audio_frame_header(const AudioFrameHeader& header, char* out) {
+    write_u32(header.session_id, out);
+    write_u32(header.sequence, out + 4);
+    write_u32(header.sample_count, out + 8);
+    write_u16(header.format, out + 12);
+    write_u16(header.reserved, out + 14);
+}
+
+void decode_samples(const char* data, size_t count, uint16_t format, float* out) {
+    if (format == SAMPLE_FORMAT_FLOAT32) {
+#if HOST_LITTLE_ENDIAN
+        std::memcpy(out, data, count * sizeof(float));
+#else
+        for (size_t i = 0; i < count; i++) {
+            uint32_t bits = read_u32(data + i * 4);
+            std::memcpy(out + i, &bits, sizeof(float));
+        }
+#endif
+    } else if (format == SAMPLE_FORMAT_INT16) {
+        const float scale = 1.0f / 32768.0f;
+        for (size_t i = 0; i < count; i++) {
+            out[i] = static_cast<int16_t>(read_u16(data + i * 2)) * scale;
+        }
+    }
+}
+
+void encode_features_header(const FeaturesHeader& header, char* out) {
+    write_u32(header.session_id, out);
+    write_u32(header.sequence, out + 4);
+    write_u32(header.value_count, out + 8);
+    write_u32(header.frame_sequence, out + 12);
+    write_u64(header.received_at, out + 16);
+    write_u64(header.analysed_at, out + 24);
+    write_u32(header.skipped, out + 32);
+}
+
+bool decode_features_header(const char* data, size_t size, FeaturesHeader& header) {
+    if (size < FEATURES_HEADER_SIZE) {
+        return false;
+    }
+
+    header.session_id = read_u32(data);
+    header.sequence = read_u32(data + 4);
+    header.value_count = read_u32(data + 8);
+    header.frame_sequence = read_u32(data + 12);
+    header.received_at = read_u64(data + 16);
+    header.analysed_at = read_u64(data + 24);
+    header.skipped = read_u32(data + 32);
+    return size - FEATURES_HEADER_SIZE >= static_cast<size_t>(header.value_count) * 4;
+}
+
+void encode_values(const float* values, size_t count, char* out) {
+#if HOST_LITTLE_ENDIAN
+    std::memcpy(out, values, count * sizeof(float));
+#else
+    for (size_t i = 0; i < count; i++) {
+        uint32_t bits;
+        std::memcpy(&bits, values + i, sizeof(float));
+        write_u32(bits, out + i * 4);
+    }
+#endif
+}
+
+void encode_quantized_features_header(const QuantizedFeaturesHeader& header, char* out) {
+    encode_features_header(header.features, out);
+    out[36] = static_cast<char>(header.bits);
+    out[37] = static_cast<char>(header.flags);
+    write_u16(header.reserved, out + 38);
+}
+
+bool decode_quantized_features_header(const char* data, size_t size,
+                                      QuantizedFeaturesHeader& header) {
+    if (size < QUANTIZED_FEATURES_HEADER_SIZE) {
+        return false;
+    }
+
+    // value_count counts features here, their sizes depend on the schema
+    decode_features_header(data, FEATURES_HEADER_SIZE, header.features);
+    header.bits = static_cast<uint8_t>(data[36]);
+    header.flags = static_cast<uint8_t>(data[37]);
+    header.reserved = read_u16(data + 38);
+    return (header.bits == 8 || header.bits == 16) && header.reserved == 0;
+}
+
+size_t quantized_feature_size(size_t count, unsigned int bits) {
+    if (count == 1) {
+        return 2 + 4;
+    }
+    return 2 + 8 + count * (bits / 8);
+}
+
+void encode_quantized_feature(uint16_t index, const float* values, size_t count,
+                              unsigned int bits, char* out, float* decoded) {
+    write_u16(index, out);
+    if (count == 1) {
+        encode_values(values, 1, out + 2);
+        decoded[0] = values[0];
+        return;
+    }
+
+    // the range of the finite values, so a stray NaN or infinity does not spoil the others
+    float min = INFINITY;
+    float max = -INFINITY;
+    for (size_t i = 0; i < count; i++) {
+        if (std::isfinite(values[i])) {
+            min = std::min(min, values[i]);
+            max = std::max(max, values[i]);
+        }
+    }
+    if (min > max) {
+        min = max = 0;
+    }
+
+    float levels = static_cast<float>((1u << bits) - 1);
+    float step = (max - min) / levels;
+    encode_values(&min, 1, out + 2);
+    encode_values(&step, 1, out + 6);
+
+    char* quantized = out + 10;
+    for (size_t i = 0; i < count; i++) {
+        float level = step > 0 ? std::round((values[i] - min) / step) : 0;
+        // also catches NaN, which fails every comparison
+        if (!(level >= 0)) {
+            level = 0;
+        } else if (level > levels) {
+            level = levels;
+        }
+
+        uint32_t q = static_cast<uint32_t>(level);
+        if (bits == 8) {
+            quantized[i] = static_cast<char>(q);
+        } else {
+            write_u16(static_cast<uint16_t>(q), quantized + i * 2);
+        }
+        decoded[i] = min + q * step;
+    }
+}
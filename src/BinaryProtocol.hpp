@@ -0,0 +1,122 @@
+#ifndef _BINARY_PROTOCOL
+#define _BINARY_PROTOCOL
+
+#include <cstddef>
+#include <cstdint>
+
+// Binary (websocket opcode 0x2) messages sent by clients carry one hop of audio.
+// All fields are little-endian:
+//
+//  offset  size  field
+//       0     4  session_id    (from the subscription_confirmation payload)
+//       4     4  sequence      (incremented by the client for every frame)
+//       8     4  sample_count
+//      12     2  format        (see SampleFormat)
+//      14     2  reserved      (must be 0)
+//      16     -  sample_count samples in the given format
+#define AUDIO_FRAME_HEADER_SIZE 16
+
+enum SampleFormat : uint16_t {
+    SAMPLE_FORMAT_FLOAT32 = 0,
+    SAMPLE_FORMAT_INT16 = 1,
+};
+
+struct AudioFrameHeader {
+    uint32_t session_id;
+    uint32_t sequence;
+    uint32_t sample_count;
+    uint16_t format;
+    uint16_t reserved;
+};
+
+// Binary messages sent by the server carry the features of one hop, packed as described by the
+// schema in the subscription_confirmation payload. All fields are little-endian:
+//
+//  offset  size  field
+//       0     4  session_id
+//       4     4  sequence        (incremented by the server for every analysed hop)
+//       8     4  value_count
+//      12     4  frame_sequence  (of the last audio frame the hop analysed)
+//      16     8  received_at     (when that frame was received, microseconds since the epoch)
+//      24     8  analysed_at     (when the hop was analysed, microseconds since the epoch)
+//      32     4  skipped         (samples the backlog policy skipped before the hop)
+//      36     -  value_count float32 values
+#define FEATURES_HEADER_SIZE 36
+
+struct FeaturesHeader {
+    uint32_t session_id;
+    uint32_t sequence;
+    uint32_t value_count;
+    uint32_t frame_sequence;
+    uint64_t received_at;
+    uint64_t analysed_at;
+    uint32_t skipped;
+};
+
+// Sessions that ask for a quantized encoding get binary features messages with a longer header,
+// followed by only the features that changed since the previous message (every feature in key
+// frames). All fields are little-endian:
+//
+//  offset  size  field
+//       0    36  the features header above, with value_count holding the number of features
+//      36     1  bits            (8 or 16, the size of every quantized value)
+//      37     1  flags           (QUANTIZED_KEY_FRAME when every feature of the schema follows)
+//      38     2  reserved        (0)
+//      40     -  value_count features, each:
+//                   0     2  index of the feature in the schema
+//                   2     4  float32 value, for features of a single value, otherwise:
+//                   2     4  float32 min
+//                   6     4  float32 step
+//                  10     -  length unsigned values of `bits` bits, each standing for
+//                            min + value * step
+#define QUANTIZED_FEATURES_HEADER_SIZE 40
+#define QUANTIZED_KEY_FRAME 1
+
+struct QuantizedFeaturesHeader {
+    FeaturesHeader features;
+    uint8_t bits;
+    uint8_t flags;
+    uint16_t reserved;
+};
+
+// Returns the size in bytes of one sample in the given format, or 0 if it is unknown
+size_t sample_size(uint16_t format);
+
+// Parses and validates the header of a binary audio frame. Returns false if the message is
+// malformed: too short, unknown format, reserved bits set or a payload that does not match
+// sample_count.
+bool decode_audio_frame_header(const char* data, size_t size, AudioFrameHeader& header);
+
+// Writes a binary audio frame header into out (AUDIO_FRAME_HEADER_SIZE bytes)
+void encode_audio_frame_header(const AudioFrameHeader& header, char* out);
+
+// Converts count little-endian samples in the given format to floats in [-1, 1]
+void decode_samples(const char* data, size_t count, uint16_t format, float* out);
+
+// Writes a binary features header into out (FEATURES_HEADER_SIZE bytes)
+void encode_features_header(const FeaturesHeader& header, char* out);
+
+// Parses the header of a binary features message. Returns false if the message is too short for
+// its value_count.
+bool decode_features_header(const char* data, size_t size, FeaturesHeader& header);
+
+// Writes a quantized features header into out (QUANTIZED_FEATURES_HEADER_SIZE bytes)
+void encode_quantized_features_header(const QuantizedFeaturesHeader& header, char* out);
+
+// Parses the header of a quantized features message. Returns false if the message is too short,
+// its bits are not 8 or 16 or its reserved bits are set.
+bool decode_quantized_features_header(const char* data, size_t size,
+                                      QuantizedFeaturesHeader& header);
+
+// Size in bytes of the record of a feature of count values quantized to bits
+size_t quantized_feature_size(size_t count, unsigned int bits);
+
+// Writes the record of the feature at index into out (quantized_feature_size bytes). The values
+// a client decodes from it are written into decoded, which may alias values.
+void encode_quantized_feature(uint16_t index, const float* values, size_t count,
+                              unsigned int bits, char* out, float* decoded);
+
+// Writes count floats into out as little-endian float32
+void encode_values(const float* values, size_t count, char* out);
+
+#endif
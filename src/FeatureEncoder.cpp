@@ -0,0 +1,153 @@
+#include <algorithm>
+#include <cmath>
+
+#include "BinaryProtocol.hpp"
+#include "FeatureEncoder.hpp"
+#include "JsonWriter.hpp"
+
+FeatureEncoder::FeatureEncoder(unsigned int session_id, bool binary, unsigned int precision,
+                               const EncodingOptions& encoding)
+    : session_id_(session_id), binary_(binary), precision_(precision), encoding_(encoding),
+      quantized_messages_(0) {}
+
+void FeatureEncoder::write(unsigned int sequence, const FeatureFrame& frame, std::string& out) {
+    out.clear();
+    if (binary_ && encoding_.bits != 0) {
+        write_quantized(sequence, frame, out);
+    } else if (binary_) {
+        write_binary(sequence, frame, out);
+    } else {
+        write_json(sequence, frame, out);
+    }
+}
+
+// The values packed in the order of the schema the session was sent
+void FeatureEncoder::write_binary(unsigned int sequence, const FeatureFrame& frame,
+                                  std::string& out) {
+    const FrameOrigin& origin = frame.origin();
+    FeaturesHeader header = {session_id_, sequence, uint32_t(frame.size()), origin.frame_sequence,
+                             origin.received_at, origin.analysed_at, origin.skipped};
+    out.resize(FEATURES_HEADER_SIZE + frame.size() * sizeof(float));
+    encode_features_header(header, &out[0]);
+    encode_values(frame.data(), frame.size(), &out[FEATURES_HEADER_SIZE]);
+}
+
+// Only the features that changed beyond the threshold since the client last got them, all of
+// them in key frames. Changes are measured against the values the client decoded, so the error
+// of what it holds stays within the threshold plus half a quantization step.
+void FeatureEncoder::write_quantized(unsigned int sequence, const FeatureFrame& frame,
+                                     std::string& out) {
+    // the first message is always a key frame
+    if (decoded_.size() != frame.size()) {
+        decoded_.assign(frame.size(), 0);
+        quantized_messages_ = 0;
+    }
+    bool key_frame = quantized_messages_ == 0;
+    if (encoding_.key_interval > 0 && quantized_messages_ % encoding_.key_interval == 0) {
+        key_frame = true;
+    }
+    quantized_messages_++;
+
+    out.resize(QUANTIZED_FEATURES_HEADER_SIZE);
+    const std::vector<FeatureSlot>& slots = frame.schema().slots();
+    uint32_t count = 0;
+    for (size_t i = 0; i < slots.size(); i++) {
+        const FeatureSlot& slot = slots[i];
+        const float* values = frame.values(slot);
+        float* decoded = &decoded_[slot.offset];
+
+        if (!key_frame) {
+            float peak = 0;
+            float change = 0;
+            for (size_t j = 0; j < slot.length; j++) {
+                peak = std::max(peak, std::fabs(decoded[j]));
+                change = std::max(change, std::fabs(values[j] - decoded[j]));
+                // a value that becomes or stops being NaN (no onset) always changed
+                if (std::isnan(values[j]) != std::isnan(decoded[j])) {
+                    change = INFINITY;
+                }
+            }
+            if (change <= encoding_.threshold * peak) {
+                continue;
+            }
+        }
+
+        size_t offset = out.size();
+        out.resize(offset + quantized_feature_size(slot.length, encoding_.bits));
+        encode_quantized_feature(uint16_t(i), values, slot.length, encoding_.bits, &out[offset],
+                                 decoded);
+        count++;
+    }
+
+    const FrameOrigin& origin = frame.origin();
+    QuantizedFeaturesHeader header = {
+        {session_id_, sequence, count, origin.frame_sequence, origin.received_at,
+         origin.analysed_at, origin.skipped},
+        uint8_t(encoding_.bits),
+        uint8_t(key_frame ? QUANTIZED_KEY_FRAME : 0),
+        0};
+    encode_quantized_features_header(header, &out[0]);
+}
+
+// The audio_features message, which parses to the document jsoncpp would write for the same
+// values. The message and payload fields are in jsoncpp's alphabetical order, the features are
+// in schema order, then the labels.
+void FeatureEncoder::write_json(unsigned int sequence, const FeatureFrame& frame,
+                                std::string& out) {
+    const FrameOrigin& origin = frame.origin();
+    out += "{\"payload\":{\"analysed_at\":";
+    write_json_uint(out, origin.analysed_at);
+
+    out += ",\"features\":{";
+    bool first = true;
+    for (auto const& slot : frame.schema().slots()) {
+        if (!first) {
+            out += ',';
+        }
+        first = false;
+        write_json_string(out, slot.name);
+        out += ":[";
+        // outputs with any number of values per hop are sent whole, not as their packed slot
+        const essentia::Real* values = frame.values(slot);
+        size_t length = slot.length;
+        if (slot.events >= 0) {
+            values = frame.events(slot.events).data();
+            length = frame.events(slot.events).size();
+        }
+        for (size_t i = 0; i < length; i++) {
+            if (i > 0) {
+                out += ',';
+            }
+            write_json_number(out, values[i], precision_);
+        }
+        out += ']';
+    }
+    const std::vector<std::string>& labels = frame.schema().labels();
+    for (size_t i = 0; i < labels.size(); i++) {
+        if (!first) {
+            out += ',';
+        }
+        first = false;
+        write_json_string(out, labels[i]);
+        out += ':';
+        write_json_string(out, frame.label(i));
+    }
+
+    out += "},\"frame_sequence\":";
+    write_json_uint(out, origin.frame_sequence);
+    out += ",\"received_at\":";
+    write_json_uint(out, origin.received_at);
+    out += ",\"sequence\":";
+    write_json_uint(out, sequence);
+    out += ",\"skipped\":";
+    write_json_uint(out, origin.skipped);
+    out += "},\"type\":\"audio_features\"}";
+}
+
+Json::Value EncodingOptions::to_json() const {
+    Json::Value json;
+    json["bits"] = bits;
+    json["threshold"] = threshold;
+    json["key_interval"] = key_interval;
+    return json;
+}
@@ -0,0 +1,54 @@
+#ifndef _FEATURE_ENCODER
+#define _FEATURE_ENCODER
+
+#include <string>
+#include <vector>
+
+#include <json/json.h>
+
+#include "FeatureFrame.hpp"
+
+// How binary messages encode their values
+struct EncodingOptions {
+    EncodingOptions() : bits(0), threshold(0.01), key_interval(32) {}
+
+    // 8 or 16 for quantized values, 0 for float32 values
+    unsigned int bits;
+    // quantized messages leave out the features whose values all moved by less than this
+    // fraction of their largest magnitude since the client last got them
+    double threshold;
+    // every key_interval-th quantized message carries every feature, 0 for only the first one
+    unsigned int key_interval;
+
+    Json::Value to_json() const;
+};
+
+// Writes the audio_features messages of a session as JSON, float32 or quantized binary. A
+// message is written into a string the caller reuses, so once it has grown to the largest
+// message, encoding allocates nothing.
+class FeatureEncoder {
+public:
+    FeatureEncoder(unsigned int session_id, bool binary, unsigned int precision,
+                   const EncodingOptions& encoding);
+
+    // Replaces out with the message of a frame, sequence counts the session's hops
+    void write(unsigned int sequence, const FeatureFrame& frame, std::string& out);
+
+private:
+    void write_binary(unsigned int sequence, const FeatureFrame& frame, std::string& out);
+    void write_json(unsigned int sequence, const FeatureFrame& frame, std::string& out);
+    void write_quantized(unsigned int sequence, const FeatureFrame& frame, std::string& out);
+
+    unsigned int session_id_;
+    bool binary_;
+    // significant digits of JSON values
+    unsigned int precision_;
+    EncodingOptions encoding_;
+
+    // the values of the last quantized features the client got, as it decodes them, and the
+    // quantized messages sent so far
+    std::vector<float> decoded_;
+    unsigned long quantized_messages_;
+};
+
+#endif
@@ -0,0 +1,51 @@
+#include "FeatureFrame.hpp"
+
+FeatureFrame::FeatureFrame(std::shared_ptr<const FeatureSchema> schema)
+    : schema_(schema), values_(schema->size(), 0), labels_(schema->labels().size()),
+      events_(schema->events().size()), in_flight_(false) {
+    for (auto& events : events_) {
+        events.reserve(FRAME_EVENTS_CAPACITY);
+    }
+}
+
+void FeatureFrame::clear() {
+    std::fill(values_.begin(), values_.end(), 0);
+    for (auto& label : labels_) {
+        label.clear();
+    }
+    for (auto& events : events_) {
+        events.clear();
+    }
+}
+
+void FeatureFrame::write_stream(const FeatureFrame& stream, size_t index) {
+    std::copy(stream.values_.begin(), stream.values_.end(),
+              values_.begin() + index * stream.values_.size());
+    for (size_t i = 0; i < stream.labels_.size(); i++) {
+        labels_[index * stream.labels_.size() + i] = stream.labels_[i];
+    }
+    for (size_t i = 0; i < stream.events_.size(); i++) {
+        std::vector<essentia::Real>& events = events_[index * stream.events_.size() + i];
+        events.assign(stream.events_[i].begin(), stream.events_[i].end());
+    }
+}
+
+void OutputStats::configure(const std::string& name, size_t length, size_t horizon,
+                            const PipelineConfig& config, const FeatureSchema& schema,
+                            essentia::Real scale) {
+    stats.configure(length, horizon, config.stats);
+    slots.clear();
+    for (auto stat : ALL_STATS) {
+        const FeatureSlot* slot = schema.find(name + "." + stat_name(stat));
+        if (slot != NULL) {
+            slots.push_back(std::make_pair(stat, slot));
+        }
+    }
+    this->scale = scale;
+}
+
+void OutputStats::write(FeatureFrame& frame) const {
+    for (auto const& slot : slots) {
+        stats.write(slot.first, frame.values(*slot.second), scale);
+    }
+}
@@ -0,0 +1,102 @@
+#ifndef _FEATURE_FRAME
+#define _FEATURE_FRAME
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <essentia/types.h>
+
+#include "FeatureSchema.hpp"
+#include "Pipeline.hpp"
+#include "RunningStats.hpp"
+
+// The audio a frame of features describes, in the binary features header layout
+struct FrameOrigin {
+    FrameOrigin() : frame_sequence(0), received_at(0), analysed_at(0), skipped(0) {}
+
+    // the last audio frame the hop analysed
+    uint32_t frame_sequence;
+    // microseconds since the epoch
+    uint64_t received_at;
+    uint64_t analysed_at;
+    // samples the backlog policy skipped before the hop
+    uint32_t skipped;
+};
+
+// events each list of a frame holds before it grows
+#define FRAME_EVENTS_CAPACITY 64
+
+// The values of one hop, laid out by the session's schema. Frames are allocated when a session
+// starts and reused: pipelines write into them in place and the output stage reads them by slot,
+// so no per-hop copies or string-keyed maps are needed between the two.
+class FeatureFrame {
+public:
+    explicit FeatureFrame(std::shared_ptr<const FeatureSchema> schema);
+
+    const FeatureSchema& schema() const { return *schema_; }
+
+    size_t size() const { return values_.size(); }
+    essentia::Real* data() { return values_.data(); }
+    const essentia::Real* data() const { return values_.data(); }
+
+    // First value of a slot of the schema
+    essentia::Real* values(const FeatureSlot& slot) { return values_.data() + slot.offset; }
+    const essentia::Real* values(const FeatureSlot& slot) const {
+        return values_.data() + slot.offset;
+    }
+
+    // The strings and the lists of events of the hop, by their index in the schema's labels()
+    // and events(). Strings as short as keys and scales fit in the string itself, and the lists
+    // keep their capacity, so refilling them does not allocate.
+    std::string& label(size_t index) { return labels_[index]; }
+    const std::string& label(size_t index) const { return labels_[index]; }
+    std::vector<essentia::Real>& events(size_t index) { return events_[index]; }
+    const std::vector<essentia::Real>& events(size_t index) const { return events_[index]; }
+
+    void clear();
+
+    // Copies the frame of the index-th of the streams this frame's schema lays out one after
+    // the other
+    void write_stream(const FeatureFrame& stream, size_t index);
+
+    // Set by the analyzer with the values, read by the output stage
+    FrameOrigin& origin() { return origin_; }
+    const FrameOrigin& origin() const { return origin_; }
+
+    // A frame is in flight from the time it is handed to the output stage until the output stage
+    // releases it, the analyzer only reuses frames that are not
+    void hand_off() { in_flight_.store(true, std::memory_order_relaxed); }
+    void release() { in_flight_.store(false, std::memory_order_release); }
+    bool in_flight() const { return in_flight_.load(std::memory_order_acquire); }
+
+private:
+    // shared so that frames still in flight outlive the session that laid them out
+    std::shared_ptr<const FeatureSchema> schema_;
+    std::vector<essentia::Real> values_;
+    std::vector<std::string> labels_;
+    std::vector<std::vector<essentia::Real>> events_;
+    FrameOrigin origin_;
+    std::atomic<bool> in_flight_;
+};
+
+// The running stats of an aggregated output and the slots of the frame they are written to
+struct OutputStats {
+    // Keeps the config's stats of the named output over `horizon` pushes
+    void configure(const std::string& name, size_t length, size_t horizon,
+                   const PipelineConfig& config, const FeatureSchema& schema,
+                   essentia::Real scale);
+
+    // Writes every stat into its slot
+    void write(FeatureFrame& frame) const;
+
+    RunningStats stats;
+    std::vector<std::pair<Stat, const FeatureSlot*>> slots;
+    // applied to every stat, squared for the variance
+    essentia::Real scale;
+};
+
+#endif
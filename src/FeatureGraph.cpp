@@ -0,0 +1,399 @@
+#include <algorithm>
+#include <cmath>
+
+#include "FeatureGraph.hpp"
+
+using essentia::ParameterMap;
+
+static size_t none(const PipelineConfig&) { return 0; }
+static size_t one(const PipelineConfig&) { return 1; }
+static size_t spectrum_size(const PipelineConfig& config) { return config.window_size() / 2 + 1; }
+
+static std::function<size_t(const PipelineConfig&)> fixed(size_t length) {
+    return [length](const PipelineConfig&) { return length; };
+}
+
+static ParameterMap no_parameters(const PipelineConfig&, unsigned int) { return ParameterMap(); }
+
+static ParameterMap sample_rate(const PipelineConfig& config, unsigned int) {
+    ParameterMap parameters;
+    parameters.add("sampleRate", config.sample_rate);
+    return parameters;
+}
+
+// The costs below are rough operation counts per frame of n samples, with b = n / 2 + 1 spectral
+// bins. They are only meant to compare subscriptions with each other, not to predict wall time.
+static double fft(double n) { return 2.5 * n * std::log2(std::max(n, 2.0)); }
+static double bins(double n) { return n / 2 + 1; }
+
+// Chromagram's constant-Q kernel for its lowest bin (32.7Hz at 12 bins per octave) spans
+// Q * sample_rate / 32.7 samples, rounded up to a power of two: 32768 at 44.1kHz and 48kHz
+static unsigned int chroma_frame_size(unsigned int sample_rate) {
+    double q = 1 / (std::pow(2.0, 1 / 12.0) - 1);
+    double length = q * sample_rate / 32.703;
+    unsigned int size = 1;
+    while (size < length) {
+        size <<= 1;
+    }
+    return size;
+}
+
+unsigned int frame_size(Resolution resolution, const PipelineConfig& config) {
+    switch (resolution) {
+    case RESOLUTION_SHORT:
+        return std::min(config.window_size(), 2 * config.hop_size);
+    case RESOLUTION_LONG:
+        return std::max(config.window_size(), chroma_frame_size(config.sample_rate));
+    default:
+        return config.window_size();
+    }
+}
+
+// Long frames are analysed often enough that consecutive frames overlap by 7/8
+unsigned int update_interval(Resolution resolution, const PipelineConfig& config) {
+    if (resolution != RESOLUTION_LONG) {
+        return 1;
+    }
+    return std::max(1u, frame_size(resolution, config) / (8 * std::max(config.hop_size, 1u)));
+}
+
+const char* resolution_name(Resolution resolution) {
+    switch (resolution) {
+    case RESOLUTION_SHORT:
+        return "short";
+    case RESOLUTION_LONG:
+        return "long";
+    default:
+        return "window";
+    }
+}
+
+essentia::Real output_scale(const std::string& name, const PipelineConfig& config,
+                            unsigned int frame_size) {
+    if (name == "centroid") {
+        return config.sample_rate / 2.0;
+    }
+    if (name == "mfcc") {
+        return 1.0 / frame_size;
+    }
+    return 1;
+}
+
+// Nodes at the window resolution keep their name, so network plans read like the registry
+static std::string node_id(const std::string& name, Resolution resolution) {
+    if (resolution == RESOLUTION_WINDOW) {
+        return name;
+    }
+    return name + "_" + resolution_name(resolution);
+}
+
+FeatureGraph::FeatureGraph() {
+    // intermediate stages
+
+    add({"windowing", "Windowing", {{"frame", FRAME_NODE, "frame"}}, {{"frame", "", none, false}},
+         [](const PipelineConfig&, unsigned int) {
+             ParameterMap parameters;
+             parameters.add("type", "square");
+             parameters.add("zeroPhase", true);
+             return parameters;
+         },
+         [](double n) { return n; }, false, 0});
+
+    // magnitude spectrum of the windowed frame
+    add({"fft", "Spectrum", {{"frame", "windowing", "frame"}}, {{"spectrum", "", none, false}},
+         [](const PipelineConfig&, unsigned int frame_size) {
+             ParameterMap parameters;
+             parameters.add("size", frame_size);
+             return parameters;
+         },
+         [](double n) { return fft(n) + 3 * bins(n); }, false, 0, RESOLUTION_WINDOW, KERNEL_FFT});
+
+    add({"spectral_peaks", "SpectralPeaks", {{"spectrum", "fft", "spectrum"}},
+         {{"frequencies", "", none, false}, {"magnitudes", "", none, false}}, sample_rate,
+         [](double n) { return 10 * bins(n); }, false, 0});
+
+    add({"triangle_bands", "TriangularBands", {{"spectrum", "fft", "spectrum"}},
+         {{"bands", "", none, false}},
+         [](const PipelineConfig& config, unsigned int frame_size) {
+             ParameterMap parameters;
+             parameters.add("log", false);
+             parameters.add("inputSize", frame_size / 2 + 1);
+             parameters.add("sampleRate", config.sample_rate);
+             return parameters;
+         },
+         [](double n) { return 2 * bins(n); }, false, 0});
+
+    add({"hpcp",
+         "HPCP",
+         {{"frequencies", "spectral_peaks", "frequencies"},
+          {"magnitudes", "spectral_peaks", "magnitudes"}},
+         {{"hpcp", "", none, false}},
+         [](const PipelineConfig&, unsigned int) {
+             ParameterMap parameters;
+             parameters.add("size", 48);
+             return parameters;
+         },
+         [](double) { return 10000.0; }, false, 0});
+
+    add({"super_flux_novelty", "SuperFluxNovelty", {{"bands", "triangle_bands", "bands"}},
+         {{"differences", "", none, false}},
+         [](const PipelineConfig&, unsigned int) {
+             ParameterMap parameters;
+             parameters.add("binWidth", 5);
+             parameters.add("frameWidth", 1);
+             return parameters;
+         },
+         [](double) { return 100.0; }, false, 0});
+
+    // features
+
+    add({"spectrum", "", {{"", "fft", "spectrum"}}, {{"", "spectrum", spectrum_size, true}},
+         no_parameters, bins, true, 0});
+
+    add({"rms", "RMS", {{"array", "windowing", "frame"}}, {{"rms", "rms", one, true}},
+         no_parameters, [](double n) { return 2 * n; }, true, 0, RESOLUTION_SHORT,
+         KERNEL_FRAME});
+
+    add({"energy", "Energy", {{"array", "windowing", "frame"}}, {{"energy", "energy", one, true}},
+         no_parameters, [](double n) { return 2 * n; }, true, 0, RESOLUTION_SHORT,
+         KERNEL_FRAME});
+
+    add({"centroid", "Centroid", {{"array", "fft", "spectrum"}},
+         {{"centroid", "centroid", one, true}}, no_parameters,
+         [](double n) { return 3 * bins(n); }, true, 0, RESOLUTION_WINDOW, KERNEL_SPECTRUM});
+
+    add({"loudness", "InstantPower", {{"array", FRAME_NODE, "frame"}},
+         {{"power", "loudness", one, true}}, no_parameters, [](double n) { return 2 * n; }, true,
+         0, RESOLUTION_SHORT, KERNEL_FRAME});
+
+    add({"noisiness", "Flatness", {{"array", "fft", "spectrum"}},
+         {{"flatness", "noisiness", one, true}}, no_parameters,
+         [](double n) { return 3 * bins(n); }, true, 0, RESOLUTION_WINDOW, KERNEL_SPECTRUM});
+
+    add({"pitch",
+         "PitchYinFFT",
+         {{"spectrum", "fft", "spectrum"}},
+         {{"pitch", "f0", one, true}, {"pitchConfidence", "f0_fonfidence", one, true}},
+         [](const PipelineConfig& config, unsigned int frame_size) {
+             ParameterMap parameters;
+             parameters.add("frameSize", frame_size);
+             parameters.add("sampleRate", config.sample_rate);
+             return parameters;
+         },
+         [](double n) { return fft(n) + 5 * bins(n); }, true, 0});
+
+    add({"mfcc", "MFCC", {{"spectrum", "fft", "spectrum"}},
+         {{"bands", "", none, false}, {"mfcc", "mfcc", fixed(13), true}},
+         [](const PipelineConfig&, unsigned int frame_size) {
+             ParameterMap parameters;
+             parameters.add("inputSize", frame_size / 2 + 1);
+             return parameters;
+         },
+         [](double n) { return 2 * bins(n) + 40 * 13; }, true, 0});
+
+    add({"dissonance",
+         "Dissonance",
+         {{"frequencies", "spectral_peaks", "frequencies"},
+          {"magnitudes", "spectral_peaks", "magnitudes"}},
+         {{"dissonance", "dissonance", one, true}},
+         no_parameters,
+         [](double) { return 10000.0; },
+         true,
+         0});
+
+    add({"key",
+         "Key",
+         {{"pcp", "hpcp", "hpcp"}},
+         {{"key", "key", none, false, OUTPUT_LABEL},
+          {"scale", "scale", none, false, OUTPUT_LABEL},
+          {"strength", "key_strength", one, true}},
+         [](const PipelineConfig&, unsigned int) {
+             ParameterMap parameters;
+             parameters.add("pcpSize", 48);
+             return parameters;
+         },
+         [](double) { return 48.0 * 24 * 2; },
+         true,
+         0,
+         RESOLUTION_LONG});
+
+    add({"tristimulus",
+         "Tristimulus",
+         {{"frequencies", "spectral_peaks", "frequencies"},
+          {"magnitudes", "spectral_peaks", "magnitudes"}},
+         {{"tristimulus", "tristimulus", fixed(3), true}},
+         no_parameters,
+         [](double) { return 100.0; },
+         true,
+         0});
+
+    add({"spectral_contrast",
+         "SpectralContrast",
+         {{"spectrum", "fft", "spectrum"}},
+         {{"spectralContrast", "spectral_contrast", fixed(6), true},
+          {"spectralValley", "spectral_valley", fixed(6), true}},
+         [](const PipelineConfig& config, unsigned int frame_size) {
+             ParameterMap parameters;
+             parameters.add("frameSize", frame_size);
+             parameters.add("sampleRate", config.sample_rate);
+             return parameters;
+         },
+         [](double n) { return bins(n) * std::log2(bins(n)); }, true, 0});
+
+    add({"spectral_complexity", "SpectralComplexity", {{"spectrum", "fft", "spectrum"}},
+         {{"spectralComplexity", "spectral_complexity", one, true}}, sample_rate,
+         [](double n) { return 10 * bins(n); }, true, 0});
+
+    // Chromagram needs frames of chroma_frame_size() samples, which only streaming mode provides
+    add({"chroma", "Chromagram", {{"frame", "windowing", "frame"}},
+         {{"chromagram", "chroma", fixed(12), true}}, sample_rate,
+         [](double n) { return fft(n) + 84 * bins(n) / 10; }, true, 0, RESOLUTION_LONG,
+         KERNEL_NONE, true});
+
+    // onsets are the peaks of the novelty curve, they are not aggregated. The network reports
+    // their times within the window, streaming mode the offsets of the onsets in the newest hop.
+    add({"onset", "SuperFluxPeaks", {{"novelty", "super_flux_novelty", "differences"}},
+         {{"peaks", "onset", one, false, OUTPUT_EVENTS}},
+         [](const PipelineConfig& config, unsigned int frame_size) {
+             ParameterMap parameters;
+             parameters.add("ratioThreshold", 4);
+             parameters.add("threshold", .7 / NOVELTY_MULT);
+             parameters.add("pre_max", 80);
+             parameters.add("pre_avg", 120);
+             parameters.add("frameRate", config.sample_rate * 1.0 / config.hop_size);
+             parameters.add("combine", 50);
+             return parameters;
+         },
+         [](double) { return 50.0; }, true, 1, RESOLUTION_SHORT});
+}
+
+const FeatureGraph& FeatureGraph::instance() {
+    static FeatureGraph graph;
+    return graph;
+}
+
+void FeatureGraph::add(const FeatureNode& node) {
+    index_[node.name] = nodes_.size();
+    nodes_.push_back(node);
+}
+
+const FeatureNode* FeatureGraph::node(const std::string& name) const {
+    auto iter = index_.find(name);
+    if (iter == index_.end()) {
+        return NULL;
+    }
+    return &nodes_[iter->second];
+}
+
+std::vector<std::string> FeatureGraph::features() const {
+    std::vector<std::string> names;
+    for (auto const& n : nodes_) {
+        if (n.subscribable) {
+            names.push_back(n.name);
+        }
+    }
+    return names;
+}
+
+void FeatureGraph::require(const std::string& name, Resolution resolution, bool streaming,
+                           std::map<std::string, bool>& needed) const {
+    std::string id = node_id(name, resolution);
+    if (name == FRAME_NODE || needed[id]) {
+        return;
+    }
+
+    needed[id] = true;
+
+    // the frame and FFT kernels read the raw frame, so streaming plans do not window it for them
+    const FeatureNode* n = node(name);
+    if (streaming && (n->kernel == KERNEL_FRAME || n->kernel == KERNEL_FFT)) {
+        return;
+    }
+    for (auto const& input : n->inputs) {
+        require(input.node, resolution, streaming, needed);
+    }
+}
+
+FeaturePlan FeatureGraph::plan(const PipelineConfig& config) const {
+    FeaturePlan plan;
+    std::map<std::string, bool> needed;
+
+    for (auto const& feature : config.features) {
+        const FeatureNode* n = node(feature);
+        if (n == NULL || !n->subscribable || (n->streaming_only && !config.streaming)) {
+            plan.unknown.push_back(feature);
+            continue;
+        }
+        require(feature, config.streaming ? n->resolution : RESOLUTION_WINDOW, config.streaming,
+                needed);
+    }
+
+    const Resolution resolutions[] = {RESOLUTION_SHORT, RESOLUTION_WINDOW, RESOLUTION_LONG};
+
+    plan.total_cost = 0;
+    plan.history_size = config.window_size();
+    for (auto const& n : nodes_) {
+        for (auto resolution : resolutions) {
+            std::string id = node_id(n.name, resolution);
+            if (!needed[id]) {
+                continue;
+            }
+
+            PlannedNode planned = {&n, id, resolution, frame_size(resolution, config),
+                                   update_interval(resolution, config)};
+            plan.nodes.push_back(planned);
+            plan.history_size = std::max(plan.history_size, planned.frame_size);
+
+            // the network analyses `memory` frames of the whole window per hop, streaming
+            // analyses one frame every interval hops
+            double frames_per_hop =
+                config.streaming ? 1.0 / planned.interval : std::max(config.memory, 1u);
+            double cost = frames_per_hop * n.cost(planned.frame_size);
+            plan.costs[id] = cost;
+            plan.total_cost += cost;
+        }
+    }
+
+    return plan;
+}
+
+std::string PlannedNode::input_id(const NodeInput& input) const {
+    return node_id(input.node, resolution);
+}
+
+bool FeaturePlan::contains(const std::string& name) const {
+    for (auto const& n : nodes) {
+        if (n.node->name == name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+Json::Value FeaturePlan::to_json() const {
+    Json::Value json_nodes(Json::arrayValue);
+    Json::Value json_costs(Json::objectValue);
+    Json::Value json_resolutions(Json::objectValue);
+    for (auto const& n : nodes) {
+        json_nodes.append(n.id);
+        json_costs[n.id] = costs.at(n.id);
+
+        Json::Value json_resolution;
+        json_resolution["frame_size"] = n.frame_size;
+        json_resolution["interval"] = n.interval;
+        json_resolutions[resolution_name(n.resolution)] = json_resolution;
+    }
+
+    Json::Value json_unknown(Json::arrayValue);
+    for (auto const& name : unknown) {
+        json_unknown.append(name);
+    }
+
+    Json::Value plan;
+    plan["nodes"] = json_nodes;
+    plan["cost_per_hop"] = total_cost;
+    plan["node_costs"] = json_costs;
+    plan["resolutions"] = json_resolutions;
+    plan["unknown_features"] = json_unknown;
+    return plan;
+}
@@ -0,0 +1,161 @@
+#ifndef _FEATURE_GRAPH
+#define _FEATURE_GRAPH
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <essentia/parameter.h>
+#include <json/json.h>
+
+#include "Pipeline.hpp"
+
+// The implicit source node every graph starts from: the frame being analysed, on port "frame"
+#define FRAME_NODE "frame"
+
+// The frame sizes streaming analysis runs nodes at, all cut from the same audio history. Network
+// analysis runs every node on frames of the window size.
+enum Resolution {
+    // hop_size * memory samples, every hop
+    RESOLUTION_WINDOW,
+    // two hops, every hop, for transient features that should react quickly
+    RESOLUTION_SHORT,
+    // at least the window size and long enough for Chromagram, a few times per window
+    RESOLUTION_LONG
+};
+
+// The fused kernel (see FrameStats.hpp) streaming analysis computes a node with, instead of its
+// essentia algorithm. Network analysis always runs the algorithm.
+enum FrameKernel {
+    KERNEL_NONE,
+    // sums over the raw frame, the node's inputs are not needed
+    KERNEL_FRAME,
+    // sums over the spectrum
+    KERNEL_SPECTRUM,
+    // windowing, real FFT and magnitudes in one pass over the raw frame with a shared plan (see
+    // FftCache.hpp), the node's inputs are not needed
+    KERNEL_FFT
+};
+
+// Samples per frame at a resolution
+unsigned int frame_size(Resolution resolution, const PipelineConfig& config);
+
+// Hops between two analyses at a resolution
+unsigned int update_interval(Resolution resolution, const PipelineConfig& config);
+
+const char* resolution_name(Resolution resolution);
+
+// Factor the stats of a named output are multiplied by, so that both analysis modes report the
+// same units: the centroid in Hz and mfcc independently of the frame size
+essentia::Real output_scale(const std::string& name, const PipelineConfig& config,
+                            unsigned int frame_size);
+
+// Connects an input port of a node to an output port of another node
+struct NodeInput {
+    std::string port;
+    std::string node;
+    std::string node_port;
+};
+
+// How the values of a named output reach clients
+enum OutputKind {
+    // length values per frame, packed in the frame
+    OUTPUT_VALUES,
+    // a string per frame (e.g. the key), only sent in JSON messages
+    OUTPUT_LABEL,
+    // any number of values per frame (e.g. onsets). The frame packs the first one, NaN if there
+    // is none, JSON messages carry them all.
+    OUTPUT_EVENTS
+};
+
+// An output port of a node and where its values are stored
+struct NodeOutput {
+    std::string port;
+    // name the values are stored under, empty for outputs only consumed by other nodes
+    std::string name;
+    // number of values per frame packed in the frame, 0 for outputs that are not
+    std::function<size_t(const PipelineConfig&)> length;
+    // whether the values are aggregated into .mean/.var or sent as they are
+    bool aggregated;
+    OutputKind kind;
+};
+
+// A node of the analysis graph: an intermediate stage (windowing, spectrum, ...) or a feature
+// clients can subscribe to. Nodes without an algorithm store their single input as it is.
+struct FeatureNode {
+    std::string name;
+    std::string algorithm;
+    std::vector<NodeInput> inputs;
+    std::vector<NodeOutput> outputs;
+    // parameters for frames of the given size
+    std::function<essentia::ParameterMap(const PipelineConfig&, unsigned int frame_size)>
+        parameters;
+    // rough number of floating point operations to analyse one frame of the given size
+    std::function<double(double frame_size)> cost;
+    bool subscribable;
+    // tokens acquired per process() call by streaming algorithms, 0 for the default
+    int acquire_size;
+    // frame size of subscribable nodes in streaming mode, intermediate nodes run at the
+    // resolution of the nodes that read from them
+    Resolution resolution;
+    FrameKernel kernel;
+    // whether the node only works at its streaming resolution, so network plans leave it out
+    bool streaming_only;
+};
+
+// A node of a plan at the resolution it runs at. A node read by features of different
+// resolutions is planned once per resolution.
+struct PlannedNode {
+    const FeatureNode* node;
+    // the node name, suffixed with the resolution unless it runs at the window size
+    std::string id;
+    Resolution resolution;
+    unsigned int frame_size;
+    unsigned int interval;
+
+    // id of the node an input reads from
+    std::string input_id(const NodeInput& input) const;
+};
+
+// The minimal set of nodes needed to compute a subscription, in dependency order
+struct FeaturePlan {
+    std::vector<PlannedNode> nodes;
+    std::vector<std::string> unknown;
+    // by planned node id
+    std::map<std::string, double> costs;
+    double total_cost;
+    // samples of audio history the plan reads, the largest frame size
+    unsigned int history_size;
+
+    bool contains(const std::string& name) const;
+
+    // Estimated cost per hop, and the nodes the subscription was expanded into
+    Json::Value to_json() const;
+};
+
+// Declarative registry of every node the analysis pipelines can build
+class FeatureGraph {
+public:
+    static const FeatureGraph& instance();
+
+    const FeatureNode* node(const std::string& name) const;
+
+    // Names of every feature clients can subscribe to
+    std::vector<std::string> features() const;
+
+    // Builds the plan for the config's features, sharing intermediate nodes between them
+    FeaturePlan plan(const PipelineConfig& config) const;
+
+private:
+    FeatureGraph();
+    void add(const FeatureNode& node);
+    void require(const std::string& name, Resolution resolution, bool streaming,
+                 std::map<std::string, bool>& needed) const;
+
+    // in dependency order: every node comes after the nodes it reads from
+    std::vector<FeatureNode> nodes_;
+    std::map<std::string, size_t> index_;
+};
+
+#endif
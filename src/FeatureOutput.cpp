@@ -0,0 +1,148 @@
+#include <algorithm>
+
+#include "Allocations.hpp"
+#include "FeatureOutput.hpp"
+
+// how often a connection whose send buffer is full is checked again
+#define BACKPRESSURE_POLL std::chrono::milliseconds(2)
+
+// frames pushed but not drained yet, more are dropped
+#define MAX_INCOMING 64
+// frames a queue may hold, whatever the client asked for
+#define MAX_QUEUE 4096
+
+FeatureOutput::FeatureOutput(WebsocketServer& server, ClientConnection conn,
+                             unsigned int session_id, bool binary, const DeliveryOptions& options,
+                             const EncodingOptions& encoding,
+                             std::shared_ptr<SessionMetrics> metrics)
+    : server_(server), conn_(conn), binary_(binary), options_(options),
+      encoder_(session_id, binary, options.precision, encoding), strand_(server.strand(conn)),
+      drain_posted_(false), timer_(server.event_loop()), retrying_(false), dropped_(0),
+      metrics_(metrics), serialize_timer_(Metrics::instance().stage("serialize")) {
+    options_.max_queue = std::min<size_t>(std::max<size_t>(options_.max_queue, 1), MAX_QUEUE);
+    incoming_.allocate(MAX_INCOMING);
+    pending_.allocate(options_.max_queue);
+
+    // a connection that is already gone gets a strand of its own, its sends are ignored
+    if (!strand_) {
+        strand_ = std::make_shared<asio::io_service::strand>(server.event_loop());
+    }
+}
+
+// Frames still waiting go back to the analyzer, the timer is cancelled with the object
+FeatureOutput::~FeatureOutput() {
+    Pending pending;
+    while (incoming_.peek(pending)) {
+        pending.second->release();
+        incoming_.skip(1);
+    }
+    while (pending_.peek(pending)) {
+        pending.second->release();
+        pending_.skip(1);
+    }
+}
+
+void FeatureOutput::push(unsigned int sequence, std::shared_ptr<FeatureFrame> frame) {
+    Pending pending(sequence, frame);
+    if (!incoming_.write(&pending, 1)) {
+        frame->release();
+        dropped_++;
+        metrics_->features_dropped++;
+        return;
+    }
+
+    // the posted drain takes every frame pushed before it runs and keeps the output alive
+    if (!drain_posted_.exchange(true)) {
+        strand_->post(DrainHandler{shared_from_this()});
+    }
+}
+
+void FeatureOutput::drain() {
+    // cleared first, so frames pushed from now on post another drain if this one misses them
+    drain_posted_.exchange(false);
+
+    Pending pending;
+    while (incoming_.peek(pending)) {
+        incoming_.skip(1);
+        enqueue(pending.first, pending.second);
+    }
+}
+
+void FeatureOutput::enqueue(unsigned int sequence, std::shared_ptr<FeatureFrame> frame) {
+    size_t capacity = options_.policy == DELIVERY_LATEST ? 1 : options_.max_queue;
+    while (pending_.size() >= capacity) {
+        drop_front();
+    }
+    Pending pending(sequence, frame);
+    pending_.write(&pending, 1);
+
+    if (!retrying_) {
+        flush();
+    }
+    metrics_->queue_depth = pending_.size();
+}
+
+void FeatureOutput::drop_front() {
+    Pending front;
+    pending_.peek(front);
+    pending_.skip(1);
+    front.second->release();
+    dropped_++;
+    metrics_->features_dropped++;
+}
+
+// Sends waiting frames, oldest first, until the rate limit or the client's backlog stops it
+void FeatureOutput::flush() {
+    while (!pending_.empty()) {
+        auto now = std::chrono::steady_clock::now();
+        if (options_.max_rate > 0) {
+            auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(1 / options_.max_rate));
+            if (now < last_send_ + interval) {
+                retry(last_send_ + interval - now);
+                return;
+            }
+        }
+
+        if (server_.buffered_amount(conn_) > options_.max_buffered) {
+            retry(BACKPRESSURE_POLL);
+            return;
+        }
+
+        Pending next;
+        pending_.peek(next);
+        pending_.skip(1);
+        send(next.first, *next.second);
+        next.second->release();
+        last_send_ = now;
+        metrics_->features_sent++;
+        metrics_->queue_depth = pending_.size();
+    }
+}
+
+void FeatureOutput::retry(std::chrono::steady_clock::duration delay) {
+    retrying_ = true;
+    timer_.expires_after(delay);
+
+    // the timer does not keep the output alive, destroying it cancels the wait
+    std::weak_ptr<FeatureOutput> self = shared_from_this();
+    timer_.async_wait(strand_->wrap([self](const asio::error_code& ec) {
+        auto output = self.lock();
+        if (ec || !output) {
+            return;
+        }
+        output->retrying_ = false;
+        output->flush();
+    }));
+}
+
+void FeatureOutput::send(unsigned int sequence, const FeatureFrame& frame) {
+    ScopedTimer timer(serialize_timer_);
+
+    // the message is written straight into one of the connection's pooled messages
+    server_.send_written(conn_, binary_, [this, sequence, &frame](std::string& payload) {
+        unsigned long long allocations = thread_allocations();
+        encoder_.write(sequence, frame, payload);
+        metrics_->serialize_allocations += thread_allocations() - allocations;
+    });
+}
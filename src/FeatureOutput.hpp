@@ -0,0 +1,160 @@
+#ifndef _FEATURE_OUTPUT
+#define _FEATURE_OUTPUT
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifndef ASIO_STANDALONE
+#define ASIO_STANDALONE
+#endif
+
+#include <asio/io_service.hpp>
+#include <asio/steady_timer.hpp>
+
+#include "FeatureEncoder.hpp"
+#include "FeatureFrame.hpp"
+#include "JsonWriter.hpp"
+#include "Metrics.hpp"
+#include "SampleRing.hpp"
+#include "WebsocketServer.hpp"
+
+// What happens to frames produced while the client is still reading the previous ones
+enum DeliveryPolicy {
+    // frames wait in a queue of at most max_queue frames, the oldest are dropped when it is full
+    DELIVERY_QUEUE,
+    // only the newest frame waits, so the client always gets the latest features
+    DELIVERY_LATEST
+};
+
+struct DeliveryOptions {
+    DeliveryOptions()
+        : policy(DELIVERY_QUEUE), max_rate(0), max_queue(16), max_buffered(64 * 1024),
+          precision(FLOAT_DIGITS) {}
+
+    DeliveryPolicy policy;
+    // messages per second, 0 for no limit
+    double max_rate;
+    size_t max_queue;
+    // bytes websocketpp may hold unsent for the connection before frames wait instead
+    size_t max_buffered;
+    // significant digits of the values of JSON messages, the default reads back exactly
+    unsigned int precision;
+};
+
+// Memory for one posted handler, reused by every handler that is posted after the previous one
+// completed. asio frees a handler's memory before invoking it. Larger or overlapping handlers
+// fall back to the heap.
+class HandlerMemory {
+public:
+    void* allocate(size_t size) {
+        if (size <= sizeof(storage_) && !in_use_.exchange(true)) {
+            return &storage_;
+        }
+        return ::operator new(size);
+    }
+
+    void deallocate(void* p) {
+        if (p == &storage_) {
+            in_use_ = false;
+        } else {
+            ::operator delete(p);
+        }
+    }
+
+private:
+    std::aligned_storage<256>::type storage_;
+    std::atomic<bool> in_use_{false};
+};
+
+// Allocator asio uses for the memory of handlers that name it as their allocator_type
+template <typename T> class HandlerAllocator {
+public:
+    typedef T value_type;
+
+    explicit HandlerAllocator(HandlerMemory* memory) : memory_(memory) {}
+    template <typename U>
+    HandlerAllocator(const HandlerAllocator<U>& other) : memory_(other.memory_) {}
+
+    T* allocate(size_t n) { return static_cast<T*>(memory_->allocate(sizeof(T) * n)); }
+    void deallocate(T* p, size_t) { memory_->deallocate(p); }
+
+    bool operator==(const HandlerAllocator& other) const { return memory_ == other.memory_; }
+    bool operator!=(const HandlerAllocator& other) const { return memory_ != other.memory_; }
+
+private:
+    template <typename> friend class HandlerAllocator;
+    HandlerMemory* memory_;
+};
+
+// Delivers the feature frames of a session to its client. A frame is only handed to websocketpp
+// when the connection's send buffer has drained below max_buffered and the rate limit allows it,
+// otherwise it waits according to the policy. Slow clients therefore cost at most max_queue
+// frames of memory and see no more latency than the policy implies.
+// Frames are serialised and sent on the connection's strand, so outputs of different sessions
+// run in parallel on the networking threads. push() may be called from one thread at a time (the
+// analyzer's); it hands frames over through a lock-free ring and posts at most one drain at a
+// time, in memory the output owns, so steady-state hops allocate nothing.
+class FeatureOutput : public std::enable_shared_from_this<FeatureOutput> {
+public:
+    FeatureOutput(WebsocketServer& server, ClientConnection conn, unsigned int session_id,
+                  bool binary, const DeliveryOptions& options, const EncodingOptions& encoding,
+                  std::shared_ptr<SessionMetrics> metrics);
+    ~FeatureOutput();
+
+    // Takes a frame from the analyzer, sends what the policy allows and releases sent or dropped
+    // frames back to the analyzer
+    void push(unsigned int sequence, std::shared_ptr<FeatureFrame> frame);
+
+    // Frames dropped or replaced before they could be sent
+    unsigned long dropped() const { return dropped_; }
+
+private:
+    typedef std::pair<unsigned int, std::shared_ptr<FeatureFrame>> Pending;
+
+    // Posted to the strand to move pushed frames into the queue
+    struct DrainHandler {
+        typedef HandlerAllocator<void> allocator_type;
+        allocator_type get_allocator() const { return allocator_type(&output->drain_memory_); }
+        void operator()() const { output->drain(); }
+
+        std::shared_ptr<FeatureOutput> output;
+    };
+
+    void drain();
+    void enqueue(unsigned int sequence, std::shared_ptr<FeatureFrame> frame);
+    void flush();
+    void retry(std::chrono::steady_clock::duration delay);
+    void drop_front();
+    void send(unsigned int sequence, const FeatureFrame& frame);
+
+    WebsocketServer& server_;
+    ClientConnection conn_;
+    bool binary_;
+    DeliveryOptions options_;
+    // only used on the strand
+    FeatureEncoder encoder_;
+
+    WebsocketServer::Strand strand_;
+    // written by push(), read on the strand
+    SpscRing<Pending> incoming_;
+    std::atomic<bool> drain_posted_;
+    HandlerMemory drain_memory_;
+    // only touched on the strand, oldest first. Slots keep the last frame they held until they
+    // are reused, frames are recycled by their in-flight flag so this does not delay them.
+    SpscRing<Pending> pending_;
+    asio::steady_timer timer_;
+    bool retrying_;
+    std::chrono::steady_clock::time_point last_send_;
+
+    std::atomic<unsigned long> dropped_;
+    // shared with the analyzer, drains, retries and sends may run after it is gone
+    std::shared_ptr<SessionMetrics> metrics_;
+    Histogram* serialize_timer_;
+};
+
+#endif
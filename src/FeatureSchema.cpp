@@ -0,0 +1,101 @@
+#include <algorithm>
+
+#include "FeatureSchema.hpp"
+
+FeatureSchema::FeatureSchema() : size_(0) {}
+
+// Every numeric output the plan stores becomes a slot, aggregated outputs get one for each of
+// the config's stats. String outputs are only listed as labels.
+FeatureSchema::FeatureSchema(const FeaturePlan& plan, const PipelineConfig& config) : size_(0) {
+    for (auto const& planned : plan.nodes) {
+        for (auto const& output : planned.node->outputs) {
+            if (!output.name.empty() && output.kind == OUTPUT_LABEL) {
+                labels_.push_back(output.name);
+            }
+            size_t length = output.length(config);
+            if (output.name.empty() || length == 0) {
+                continue;
+            }
+
+            if (output.aggregated) {
+                for (auto stat : ALL_STATS) {
+                    if (config.stats & stat) {
+                        add(output.name + "." + stat_name(stat), length);
+                    }
+                }
+            } else if (output.kind == OUTPUT_EVENTS) {
+                add(output.name, length, static_cast<int>(events_.size()));
+                events_.push_back(output.name);
+            } else {
+                add(output.name, length);
+            }
+        }
+    }
+}
+
+FeatureSchema::FeatureSchema(const FeatureSchema& stream, const std::vector<std::string>& names)
+    : size_(0) {
+    for (auto const& name : names) {
+        for (auto const& slot : stream.slots()) {
+            int events = slot.events;
+            if (events >= 0) {
+                events += static_cast<int>(events_.size());
+            }
+            add(name + "." + slot.name, slot.length, events);
+        }
+        for (auto const& label : stream.labels()) {
+            labels_.push_back(name + "." + label);
+        }
+        for (auto const& events : stream.events()) {
+            events_.push_back(name + "." + events);
+        }
+    }
+}
+
+void FeatureSchema::add(const std::string& name, size_t length, int events) {
+    slots_.push_back({name, size_, length, events});
+    size_ += length;
+}
+
+Json::Value FeatureSchema::to_json() const {
+    Json::Value json_slots(Json::arrayValue);
+    for (auto const& slot : slots_) {
+        Json::Value json_slot;
+        json_slot["name"] = slot.name;
+        json_slot["offset"] = static_cast<Json::UInt>(slot.offset);
+        json_slot["length"] = static_cast<Json::UInt>(slot.length);
+        if (slot.events >= 0) {
+            json_slot["events"] = true;
+        }
+        json_slots.append(json_slot);
+    }
+
+    Json::Value json_labels(Json::arrayValue);
+    for (auto const& label : labels_) {
+        json_labels.append(label);
+    }
+
+    Json::Value schema;
+    schema["size"] = static_cast<Json::UInt>(size_);
+    schema["features"] = json_slots;
+    schema["labels"] = json_labels;
+    return schema;
+}
+
+const FeatureSlot* FeatureSchema::find(const std::string& name) const {
+    for (auto const& slot : slots_) {
+        if (slot.name == name) {
+            return &slot;
+        }
+    }
+    return NULL;
+}
+
+static int index_of(const std::vector<std::string>& names, const std::string& name) {
+    auto found = std::find(names.begin(), names.end(), name);
+    return found == names.end() ? -1 : static_cast<int>(found - names.begin());
+}
+
+int FeatureSchema::find_label(const std::string& name) const { return index_of(labels_, name); }
+
+int FeatureSchema::find_events(const std::string& name) const { return index_of(events_, name); }
@@ -0,0 +1,59 @@
+#ifndef _FEATURE_SCHEMA
+#define _FEATURE_SCHEMA
+
+#include <string>
+#include <vector>
+
+#include <json/json.h>
+
+#include "FeatureGraph.hpp"
+
+// A named range of values in a packed feature message
+struct FeatureSlot {
+    std::string name;
+    size_t offset;
+    size_t length;
+    // index of the slot's output in the schema's events(), -1 if it always has length values
+    int events;
+};
+
+// Fixed layout of the values a session produces on every hop. It is sent to the client once,
+// with the subscription confirmation, so that binary feature messages only need to carry the
+// packed float32 values.
+class FeatureSchema {
+public:
+    FeatureSchema();
+    FeatureSchema(const FeaturePlan& plan, const PipelineConfig& config);
+    // The values of several signals analysed alike, one after the other, each slot of stream
+    // named "<stream name>.<name>"
+    FeatureSchema(const FeatureSchema& stream, const std::vector<std::string>& names);
+
+    const std::vector<FeatureSlot>& slots() const { return slots_; }
+
+    // Names of the string outputs, and of the slots of outputs with any number of values per
+    // frame, see OutputKind. Frames hold their values by index in these.
+    const std::vector<std::string>& labels() const { return labels_; }
+    const std::vector<std::string>& events() const { return events_; }
+
+    // Total number of values in a packed message
+    size_t size() const { return size_; }
+
+    Json::Value to_json() const;
+
+    // The slot of the named values, NULL if the schema has none
+    const FeatureSlot* find(const std::string& name) const;
+
+    // Index of the named label or events, -1 if the schema has none
+    int find_label(const std::string& name) const;
+    int find_events(const std::string& name) const;
+
+private:
+    void add(const std::string& name, size_t length, int events = -1);
+
+    std::vector<FeatureSlot> slots_;
+    std::vector<std::string> labels_;
+    std::vector<std::string> events_;
+    size_t size_;
+};
+
+#endif
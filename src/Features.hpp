@@ -0,0 +1,9 @@
+#ifndef _FEATURES
+#define _FEATURES
+
+#include <map>
+#include <string>
+
+typedef std::map<std::string, bool> FeatureSubscription;
+
+#endif
@@ -0,0 +1,266 @@
+#include <algorithm>
+#include <cmath>
+
+#include <essentia/algorithmfactory.h>
+
+#include "FftCache.hpp"
+
+using essentia::Real;
+
+static inline FftComplex add(FftComplex a, FftComplex b) { return {a.r + b.r, a.i + b.i}; }
+static inline FftComplex sub(FftComplex a, FftComplex b) { return {a.r - b.r, a.i - b.i}; }
+static inline FftComplex mul(FftComplex a, FftComplex b) {
+    return {a.r * b.r - a.i * b.i, a.r * b.i + a.i * b.r};
+}
+static inline FftComplex conj(FftComplex a) { return {a.r, -a.i}; }
+static inline Real magnitude(FftComplex a) { return std::sqrt(a.r * a.r + a.i * a.i); }
+
+static FftComplex polar(double phase) {
+    return {float(std::cos(phase)), float(std::sin(phase))};
+}
+
+RealFft::RealFft(size_t size)
+    : size_(size), length_(size % 2 == 0 ? size / 2 : size), max_radix_(1) {
+    twiddles_.resize(length_);
+    for (size_t i = 0; i < length_; i++) {
+        twiddles_[i] = polar(-2 * M_PI * i / length_);
+    }
+
+    if (size_ % 2 == 0) {
+        split_twiddles_.resize(length_ / 2);
+        for (size_t i = 0; i < length_ / 2; i++) {
+            split_twiddles_[i] = polar(-M_PI * (double(i + 1) / length_ + 0.5));
+        }
+    }
+
+    // radix 4 first, then 2, then odd factors, the remainder if there are no more below its root
+    size_t n = std::max<size_t>(length_, 1);
+    size_t p = 4;
+    size_t root = std::floor(std::sqrt(double(n)));
+    size_t stride = 1;
+    do {
+        while (n % p != 0) {
+            p = p == 4 ? 2 : p == 2 ? 3 : p + 2;
+            if (p > root) {
+                p = n;
+            }
+        }
+        n /= p;
+
+        Level level = {p, n, stride, level_twiddles_.size()};
+        levels_.push_back(level);
+        max_radix_ = std::max(max_radix_, p);
+        stride *= p;
+
+        // the radix 2 and 4 butterflies read the twiddles of each k next to each other
+        if (p == 2 || p == 4) {
+            for (size_t k = 0; k < level.m; k++) {
+                for (size_t j = 1; j < p; j++) {
+                    level_twiddles_.push_back(twiddles_[j * k * level.stride]);
+                }
+            }
+        }
+    } while (n > 1);
+}
+
+bool RealFft::supported(size_t size) {
+    // the complex transform of even sizes is half as long
+    size_t n = size % 2 == 0 ? size / 2 : size;
+    for (size_t p = 2; p <= MAX_FFT_RADIX && n > 1; p++) {
+        while (n % p == 0) {
+            n /= p;
+        }
+    }
+    return n <= 1;
+}
+
+// the input, the transform and the scratch space of the generic butterfly
+size_t RealFft::workspace_size() const { return 2 * length_ + max_radix_; }
+
+void RealFft::magnitudes(const Real* frame, const Real* window, FftComplex* workspace,
+                         Real* out) const {
+    if (size_ == 0) {
+        out[0] = 0;
+        return;
+    }
+
+    FftComplex* in = workspace;
+    FftComplex* spectrum = workspace + length_;
+    FftComplex* scratch = workspace + 2 * length_;
+
+    // odd sizes transform the real frame as it is
+    if (size_ % 2 != 0) {
+        for (size_t k = 0; k < size_; k++) {
+            in[k] = {frame[k] * window[k], 0};
+        }
+        transform(spectrum, in, 0, scratch);
+        for (size_t k = 0; k < bins(); k++) {
+            out[k] = magnitude(spectrum[k]);
+        }
+        return;
+    }
+
+    // even sizes pack even samples into the real parts and odd ones into the imaginary parts,
+    // then split the half size transform into the spectrum of the frame
+    for (size_t k = 0; k < length_; k++) {
+        in[k] = {frame[2 * k] * window[2 * k], frame[2 * k + 1] * window[2 * k + 1]};
+    }
+    transform(spectrum, in, 0, scratch);
+
+    FftComplex dc = spectrum[0];
+    out[0] = std::fabs(dc.r + dc.i);
+    out[length_] = std::fabs(dc.r - dc.i);
+    for (size_t k = 1; k <= length_ / 2; k++) {
+        FftComplex even = add(spectrum[k], conj(spectrum[length_ - k]));
+        FftComplex odd =
+            mul(sub(spectrum[k], conj(spectrum[length_ - k])), split_twiddles_[k - 1]);
+        out[k] = 0.5f * magnitude(add(even, odd));
+        out[length_ - k] = 0.5f * magnitude(sub(even, odd));
+    }
+}
+
+// Decimation in time, one radix per level: the p interleaved sub-sequences of the input are
+// transformed into consecutive blocks of m values, which are then combined
+void RealFft::transform(FftComplex* out, const FftComplex* in, size_t level,
+                        FftComplex* scratch) const {
+    const Level& l = levels_[level];
+    size_t p = l.p;
+    size_t m = l.m;
+
+    if (m == 1) {
+        for (size_t q = 0; q < p; q++) {
+            out[q] = in[q * l.stride];
+        }
+    } else {
+        for (size_t q = 0; q < p; q++) {
+            transform(out + q * m, in + q * l.stride, level + 1, scratch);
+        }
+    }
+
+    switch (p) {
+    case 2:
+        butterfly2(out, &level_twiddles_[l.twiddles], m);
+        break;
+    case 4:
+        butterfly4(out, &level_twiddles_[l.twiddles], m);
+        break;
+    default:
+        butterfly(out, l.stride, m, p, scratch);
+        break;
+    }
+}
+
+void RealFft::butterfly2(FftComplex* out, const FftComplex* twiddles, size_t m) const {
+    for (size_t k = 0; k < m; k++) {
+        FftComplex t = mul(out[k + m], twiddles[k]);
+        out[k + m] = sub(out[k], t);
+        out[k] = add(out[k], t);
+    }
+}
+
+void RealFft::butterfly4(FftComplex* out, const FftComplex* twiddles, size_t m) const {
+    for (size_t k = 0; k < m; k++) {
+        const FftComplex* tw = twiddles + 3 * k;
+        FftComplex s0 = mul(out[k + m], tw[0]);
+        FftComplex s1 = mul(out[k + 2 * m], tw[1]);
+        FftComplex s2 = mul(out[k + 3 * m], tw[2]);
+
+        FftComplex s5 = sub(out[k], s1);
+        FftComplex s3 = add(s0, s2);
+        FftComplex s4 = sub(s0, s2);
+        FftComplex s6 = add(out[k], s1);
+
+        out[k] = add(s6, s3);
+        out[k + 2 * m] = sub(s6, s3);
+        // s4 times -i and i
+        out[k + m] = {s5.r + s4.i, s5.i - s4.r};
+        out[k + 3 * m] = {s5.r - s4.i, s5.i + s4.r};
+    }
+}
+
+// Any radix, O(p^2) per group, for the odd factors of the size up to MAX_FFT_RADIX
+void RealFft::butterfly(FftComplex* out, size_t stride, size_t m, size_t p,
+                        FftComplex* scratch) const {
+    for (size_t u = 0; u < m; u++) {
+        for (size_t q = 0; q < p; q++) {
+            scratch[q] = out[u + q * m];
+        }
+
+        for (size_t q = 0; q < p; q++) {
+            size_t k = u + q * m;
+            size_t index = 0;
+            FftComplex sum = scratch[0];
+            for (size_t j = 1; j < p; j++) {
+                // stride * k is less than length_, the index wraps at most once
+                index += stride * k;
+                if (index >= length_) {
+                    index -= length_;
+                }
+                sum = add(sum, mul(scratch[j], twiddles_[index]));
+            }
+            out[k] = sum;
+        }
+    }
+}
+
+FftCache& FftCache::instance() {
+    static FftCache cache;
+    return cache;
+}
+
+std::shared_ptr<const RealFft> FftCache::fft(size_t size) {
+    if (!RealFft::supported(size)) {
+        return NULL;
+    }
+
+    std::lock_guard<std::mutex> guard(mutex_);
+    auto& fft = ffts_[size];
+    if (!fft) {
+        fft = std::make_shared<RealFft>(size);
+    }
+    return fft;
+}
+
+std::shared_ptr<const WindowTable> FftCache::window(const essentia::ParameterMap& parameters,
+                                                    size_t size) {
+    // the parameters are few and sorted by name, their values identify the window
+    std::string key;
+    for (auto const& parameter : parameters) {
+        key += parameter.first + "=" + parameter.second.toString() + ";";
+    }
+
+    std::lock_guard<std::mutex> guard(mutex_);
+    auto& table = windows_[std::make_pair(key, size)];
+    if (table) {
+        return table;
+    }
+
+    essentia::ParameterMap unrotated;
+    for (auto const& parameter : parameters) {
+        if (parameter.first != "zeroPhase") {
+            unrotated.add(parameter.first, parameter.second);
+        }
+    }
+    unrotated.add("zeroPhase", false);
+
+    // windowing a frame of ones gives the window
+    essentia::standard::Algorithm* windowing =
+        essentia::standard::AlgorithmFactory::create("Windowing");
+    windowing->configure(unrotated);
+
+    std::vector<Real> ones(size, 1);
+    auto built = std::make_shared<WindowTable>();
+    windowing->input("frame").set(ones);
+    windowing->output("frame").set(built->window);
+    windowing->compute();
+    delete windowing;
+
+    built->window.resize(size);
+    built->squares.resize(size);
+    for (size_t i = 0; i < size; i++) {
+        built->squares[i] = built->window[i] * built->window[i];
+    }
+
+    table = built;
+    return table;
+}
@@ -0,0 +1,105 @@
+#ifndef _FFT_CACHE
+#define _FFT_CACHE
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <essentia/parameter.h>
+#include <essentia/types.h>
+
+// largest prime factor the mixed radix FFT handles, larger ones cost O(p) per value
+#define MAX_FFT_RADIX 13
+
+struct FftComplex {
+    float r;
+    float i;
+};
+
+// The plan of a forward real FFT of one size: its radix factors and twiddles. A plan never changes
+// once built, so one plan is shared by every session that analyses frames of its size; the
+// buffers it works in belong to the caller. Even sizes run as a complex FFT of half the size.
+// Mixed radix, fast for sizes made of small factors (hop sizes times memory).
+class RealFft {
+public:
+    explicit RealFft(size_t size);
+
+    // Whether the size has no prime factor above MAX_FFT_RADIX, other sizes are better left to
+    // essentia's Spectrum
+    static bool supported(size_t size);
+
+    size_t size() const { return size_; }
+    size_t bins() const { return size_ / 2 + 1; }
+
+    // Complex values the caller provides as workspace for magnitudes()
+    size_t workspace_size() const;
+
+    // Multiplies the frame by the window, transforms it and writes the bins() magnitudes, which
+    // is what essentia's Windowing and Spectrum compute (the magnitudes do not depend on
+    // Windowing's zero phase rotation)
+    void magnitudes(const essentia::Real* frame, const essentia::Real* window,
+                    FftComplex* workspace, essentia::Real* out) const;
+
+private:
+    // One level of the transform: p sub-transforms of m values, read every stride values
+    struct Level {
+        size_t p;
+        size_t m;
+        size_t stride;
+        // where the level's (p - 1) * m twiddles start in level_twiddles_
+        size_t twiddles;
+    };
+
+    void transform(FftComplex* out, const FftComplex* in, size_t level,
+                   FftComplex* scratch) const;
+    void butterfly2(FftComplex* out, const FftComplex* twiddles, size_t m) const;
+    void butterfly4(FftComplex* out, const FftComplex* twiddles, size_t m) const;
+    void butterfly(FftComplex* out, size_t stride, size_t m, size_t p,
+                   FftComplex* scratch) const;
+
+    size_t size_;
+    // length of the complex transform: size_ / 2 for even sizes, size_ for odd ones
+    size_t length_;
+    std::vector<Level> levels_;
+    std::vector<FftComplex> twiddles_;
+    // the twiddles of every level in the order its butterflies read them
+    std::vector<FftComplex> level_twiddles_;
+    // splits the half size transform of even sizes into the real spectrum
+    std::vector<FftComplex> split_twiddles_;
+    size_t max_radix_;
+};
+
+// The coefficients of a window, and their squares
+struct WindowTable {
+    std::vector<essentia::Real> window;
+    std::vector<essentia::Real> squares;
+};
+
+// Process-wide cache of FFT plans by size and window tables by parameters and size, shared
+// read-only by every pipeline. Entries live as long as the process, there are only as many as
+// there are frame sizes in use. All methods are safe to call from any thread.
+class FftCache {
+public:
+    static FftCache& instance();
+
+    // NULL for sizes RealFft does not support
+    std::shared_ptr<const RealFft> fft(size_t size);
+
+    // The window essentia's Windowing applies with the given parameters, without its zero phase
+    // rotation so that it lines up with the frame
+    std::shared_ptr<const WindowTable> window(const essentia::ParameterMap& parameters,
+                                              size_t size);
+
+private:
+    FftCache() {}
+
+    std::map<size_t, std::shared_ptr<const RealFft>> ffts_;
+    // by the parameters' names and values, and the size
+    std::map<std::pair<std::string, size_t>, std::shared_ptr<const WindowTable>> windows_;
+    std::mutex mutex_;
+};
+
+#endif
@@ -0,0 +1,147 @@
+#include <algorithm>
+#include <limits>
+
+#include "FrameStats.hpp"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using essentia::Real;
+
+// samples each lane accumulates in single precision before the lanes are added to the totals
+#define BLOCK_SIZE 512
+
+// The few vector operations the kernels need, on 8 (AVX) or 4 (SSE2) floats
+#if defined(__AVX__)
+#define LANES 8
+typedef __m256 Lanes;
+static inline Lanes lanes_zero() { return _mm256_setzero_ps(); }
+static inline Lanes lanes_set(float x) { return _mm256_set1_ps(x); }
+static inline Lanes lanes_ramp(float x) {
+    return _mm256_setr_ps(x, x + 1, x + 2, x + 3, x + 4, x + 5, x + 6, x + 7);
+}
+static inline Lanes lanes_load(const float* p) { return _mm256_loadu_ps(p); }
+static inline Lanes lanes_add(Lanes a, Lanes b) { return _mm256_add_ps(a, b); }
+static inline Lanes lanes_mul(Lanes a, Lanes b) { return _mm256_mul_ps(a, b); }
+static inline Lanes lanes_min(Lanes a, Lanes b) { return _mm256_min_ps(a, b); }
+static inline void lanes_store(float* p, Lanes a) { _mm256_storeu_ps(p, a); }
+#elif defined(__SSE2__)
+#define LANES 4
+typedef __m128 Lanes;
+static inline Lanes lanes_zero() { return _mm_setzero_ps(); }
+static inline Lanes lanes_set(float x) { return _mm_set1_ps(x); }
+static inline Lanes lanes_ramp(float x) { return _mm_setr_ps(x, x + 1, x + 2, x + 3); }
+static inline Lanes lanes_load(const float* p) { return _mm_loadu_ps(p); }
+static inline Lanes lanes_add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+static inline Lanes lanes_mul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+static inline Lanes lanes_min(Lanes a, Lanes b) { return _mm_min_ps(a, b); }
+static inline void lanes_store(float* p, Lanes a) { _mm_storeu_ps(p, a); }
+#endif
+
+#ifdef LANES
+static inline double lanes_sum(Lanes a) {
+    float lanes[LANES];
+    lanes_store(lanes, a);
+    double sum = 0;
+    for (int i = 0; i < LANES; i++) {
+        sum += lanes[i];
+    }
+    return sum;
+}
+
+static inline float lanes_smallest(Lanes a) {
+    float lanes[LANES];
+    lanes_store(lanes, a);
+    return *std::min_element(lanes, lanes + LANES);
+}
+#endif
+
+FrameEnergy frame_energy(const Real* frame, const Real* window_squares, size_t n) {
+    FrameEnergy energy = {0, 0};
+    size_t i = 0;
+
+#ifdef LANES
+    while (i + LANES <= n) {
+        size_t end = std::min(n, i + BLOCK_SIZE);
+        Lanes raw = lanes_zero();
+        Lanes windowed = lanes_zero();
+        for (; i + LANES <= end; i += LANES) {
+            Lanes x = lanes_load(frame + i);
+            Lanes squares = lanes_mul(x, x);
+            raw = lanes_add(raw, squares);
+            windowed = lanes_add(windowed, lanes_mul(squares, lanes_load(window_squares + i)));
+        }
+        energy.raw += lanes_sum(raw);
+        energy.windowed += lanes_sum(windowed);
+    }
+#endif
+
+    for (; i < n; i++) {
+        double square = double(frame[i]) * frame[i];
+        energy.raw += square;
+        energy.windowed += square * window_squares[i];
+    }
+    return energy;
+}
+
+SpectrumMoments spectrum_moments(const Real* spectrum, size_t n) {
+    SpectrumMoments moments = {0, 0, std::numeric_limits<Real>::max()};
+    size_t i = 0;
+
+#ifdef LANES
+    if (n >= LANES) {
+        Lanes min = lanes_set(std::numeric_limits<Real>::max());
+        while (i + LANES <= n) {
+            size_t end = std::min(n, i + BLOCK_SIZE);
+            Lanes sum = lanes_zero();
+            Lanes weighted_sum = lanes_zero();
+            // bin numbers are exact in single precision up to 2^24 bins
+            Lanes bin = lanes_ramp(i);
+            const Lanes step = lanes_set(LANES);
+            for (; i + LANES <= end; i += LANES) {
+                Lanes x = lanes_load(spectrum + i);
+                sum = lanes_add(sum, x);
+                weighted_sum = lanes_add(weighted_sum, lanes_mul(x, bin));
+                min = lanes_min(min, x);
+                bin = lanes_add(bin, step);
+            }
+            moments.sum += lanes_sum(sum);
+            moments.weighted_sum += lanes_sum(weighted_sum);
+        }
+        moments.min = lanes_smallest(min);
+    }
+#endif
+
+    for (; i < n; i++) {
+        moments.sum += spectrum[i];
+        moments.weighted_sum += double(i) * spectrum[i];
+        moments.min = std::min(moments.min, spectrum[i]);
+    }
+    return moments;
+}
+
+double log_sum(const Real* values, size_t n) {
+    double sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        sum += std::log(values[i]);
+    }
+    return sum;
+}
+
+Real centroid(const SpectrumMoments& moments, size_t n) {
+    if (n < 2 || moments.sum == 0) {
+        return 0;
+    }
+    return moments.weighted_sum / moments.sum / (n - 1);
+}
+
+Real flatness(const SpectrumMoments& moments, const Real* spectrum, size_t n) {
+    if (n == 0 || moments.min <= 0 || moments.sum == 0) {
+        return 0;
+    }
+    double geometric_mean = std::exp(log_sum(spectrum, n) / n);
+    return geometric_mean / (moments.sum / n);
+}
@@ -0,0 +1,51 @@
+#ifndef _FRAME_STATS
+#define _FRAME_STATS
+
+#include <cmath>
+#include <cstddef>
+
+#include <essentia/types.h>
+
+// Fused kernels for the features that are simple sums over a frame or a spectrum. Each walks its
+// input once, with AVX or SSE2 when the compiler targets them and scalar code otherwise, instead
+// of once per essentia algorithm. Lanes accumulate in single precision over short blocks that
+// are summed in double precision, which keeps the results within float rounding of essentia's.
+
+// Sums of squares of a frame: as it is, and multiplied by the window (given squared)
+struct FrameEnergy {
+    double raw;
+    double windowed;
+};
+
+FrameEnergy frame_energy(const essentia::Real* frame, const essentia::Real* window_squares,
+                         size_t n);
+
+// Sum of a spectrum, sum of its values weighted by their bin and its smallest value
+struct SpectrumMoments {
+    double sum;
+    double weighted_sum;
+    essentia::Real min;
+};
+
+SpectrumMoments spectrum_moments(const essentia::Real* spectrum, size_t n);
+
+// Sum of the natural logarithms of positive values
+double log_sum(const essentia::Real* values, size_t n);
+
+// The features essentia computes from these sums, with the same conventions
+
+// RMS and Energy of the windowed frame, InstantPower of the raw frame
+inline essentia::Real rms(double sum_squares, size_t n) {
+    return n == 0 ? 0 : std::sqrt(sum_squares / n);
+}
+inline essentia::Real instant_power(double sum_squares, size_t n) {
+    return n == 0 ? 0 : sum_squares / n;
+}
+
+// Centroid with a range of 1, i.e. as a fraction of the highest bin
+essentia::Real centroid(const SpectrumMoments& moments, size_t n);
+
+// Flatness: the geometric mean over the arithmetic mean, 0 if any bin is 0
+essentia::Real flatness(const SpectrumMoments& moments, const essentia::Real* spectrum, size_t n);
+
+#endif
@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <cmath>
+
+#include "JsonWriter.hpp"
+
+// the powers of ten a value can be scaled by, 10^-POWER_RANGE to 10^POWER_RANGE
+#define POWER_RANGE 340
+
+static const double* powers_of_ten() {
+    static const double* powers = []() {
+        static double table[2 * POWER_RANGE + 1];
+        for (int i = -POWER_RANGE; i <= POWER_RANGE; i++) {
+            table[i + POWER_RANGE] = std::pow(10.0, i);
+        }
+        return table;
+    }();
+    return powers;
+}
+
+static inline double power_of_ten(int exponent) {
+    return powers_of_ten()[std::max(-POWER_RANGE, std::min(POWER_RANGE, exponent)) + POWER_RANGE];
+}
+
+static const uint64_t INTEGER_POWERS[] = {1,      10,      100,      1000,      10000,
+                                          100000, 1000000, 10000000, 100000000, 1000000000};
+
+// Writes the decimal digits of value into the end of a buffer, returns where they start
+static char* format_uint(uint64_t value, char* end) {
+    do {
+        *--end = '0' + value % 10;
+        value /= 10;
+    } while (value != 0);
+    return end;
+}
+
+void write_json_uint(std::string& out, uint64_t value) {
+    char buffer[20];
+    char* start = format_uint(value, buffer + sizeof(buffer));
+    out.append(start, buffer + sizeof(buffer) - start);
+}
+
+void write_json_number(std::string& out, double value, unsigned int precision) {
+    if (std::isnan(value)) {
+        out += "null";
+        return;
+    }
+    if (std::isinf(value)) {
+        out += value < 0 ? "-1e+9999" : "1e+9999";
+        return;
+    }
+    if (value == 0) {
+        out += "0.0";
+        return;
+    }
+
+    int p = std::max(1, std::min(FLOAT_DIGITS, int(precision)));
+    char text[48];
+    char* cursor = text;
+    if (value < 0) {
+        *cursor++ = '-';
+        value = -value;
+    }
+
+    // the decimal exponent: 10^exponent <= value < 10^(exponent + 1), estimated from the binary
+    // one and corrected
+    int binary_exponent;
+    std::frexp(value, &binary_exponent);
+    int exponent = int(std::floor((binary_exponent - 1) * 0.30102999566398120));
+    if (value >= power_of_ten(exponent + 1)) {
+        exponent++;
+    } else if (value < power_of_ten(exponent)) {
+        exponent--;
+    }
+
+    // the p significant digits, rounded, as an integer
+    int scale = p - 1 - exponent;
+    double scaled = scale >= 0 ? value * power_of_ten(scale) : value / power_of_ten(-scale);
+    uint64_t mantissa = uint64_t(scaled);
+    double fraction = scaled - mantissa;
+    // ties to even, like printf
+    if (fraction > 0.5 || (fraction == 0.5 && mantissa % 2 == 1)) {
+        mantissa++;
+    }
+    if (mantissa >= INTEGER_POWERS[p]) {
+        mantissa /= 10;
+        exponent++;
+    }
+
+    char digits[20];
+    char* end = digits + sizeof(digits);
+    char* first = format_uint(mantissa, end);
+    while (end - first > 1 && end[-1] == '0') {
+        end--;
+    }
+    int count = end - first;
+
+    if (exponent < -4 || exponent >= p) {
+        // d.ddde+XX
+        *cursor++ = first[0];
+        if (count > 1) {
+            *cursor++ = '.';
+            cursor = std::copy(first + 1, end, cursor);
+        }
+        *cursor++ = 'e';
+        *cursor++ = exponent < 0 ? '-' : '+';
+        int magnitude = std::abs(exponent);
+        if (magnitude < 10) {
+            *cursor++ = '0';
+        }
+        char exponent_digits[4];
+        char* exponent_first = format_uint(magnitude, exponent_digits + sizeof(exponent_digits));
+        cursor = std::copy(exponent_first, exponent_digits + sizeof(exponent_digits), cursor);
+    } else if (exponent < 0) {
+        // 0.000ddd
+        *cursor++ = '0';
+        *cursor++ = '.';
+        cursor = std::fill_n(cursor, -exponent - 1, '0');
+        cursor = std::copy(first, end, cursor);
+    } else {
+        // ddd.ddd, or ddd.0 for integers
+        int integer_digits = exponent + 1;
+        if (count > integer_digits) {
+            cursor = std::copy(first, first + integer_digits, cursor);
+            *cursor++ = '.';
+            cursor = std::copy(first + integer_digits, end, cursor);
+        } else {
+            cursor = std::copy(first, end, cursor);
+            cursor = std::fill_n(cursor, integer_digits - count, '0');
+            *cursor++ = '.';
+            *cursor++ = '0';
+        }
+    }
+
+    out.append(text, cursor - text);
+}
+
+void write_json_string(std::string& out, const std::string& value) {
+    static const char HEX[] = "0123456789abcdef";
+    out += '"';
+    for (char c : value) {
+        switch (c) {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        case '\r':
+            out += "\\r";
+            break;
+        case '\t':
+            out += "\\t";
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                out += "\\u00";
+                out += HEX[(c >> 4) & 0xf];
+                out += HEX[c & 0xf];
+            } else {
+                out += c;
+            }
+        }
+    }
+    out += '"';
+}
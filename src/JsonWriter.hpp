@@ -0,0 +1,25 @@
+#ifndef _JSON_WRITER
+#define _JSON_WRITER
+
+#include <cstdint>
+#include <string>
+
+// Appends JSON text to a buffer the caller reuses, for messages whose layout is known in advance,
+// so writing them builds no document and allocates nothing once the buffer has grown. The text
+// parses to the same values jsoncpp's writer gives.
+
+// significant digits that make every float read back as itself
+#define FLOAT_DIGITS 9
+
+// A number with `precision` significant digits (1 to FLOAT_DIGITS), formatted like printf's
+// "%.<precision>g" with ".0" appended to integers, and NaN and infinities written as null and
+// +-1e+9999, as jsoncpp does. Scales by powers of ten instead of printf's exact arithmetic, which
+// gives the same digits at float precision.
+void write_json_number(std::string& out, double value, unsigned int precision);
+
+void write_json_uint(std::string& out, uint64_t value);
+
+// A quoted string, escaped
+void write_json_string(std::string& out, const std::string& value);
+
+#endif
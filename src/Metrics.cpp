@@ -0,0 +1,163 @@
+#include <cstdio>
+
+#include "Metrics.hpp"
+
+// upper bounds in seconds, the last bucket is +Inf
+static const double BUCKET_BOUNDS[HISTOGRAM_BUCKETS - 1] = {
+    0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1};
+
+Histogram::Histogram() : count_(0), sum_ns_(0) {
+    for (auto& bucket : buckets_) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+void Histogram::observe(std::chrono::steady_clock::duration duration) {
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+    double seconds = ns * 1e-9;
+
+    int bucket = 0;
+    while (bucket < HISTOGRAM_BUCKETS - 1 && seconds > BUCKET_BOUNDS[bucket]) {
+        bucket++;
+    }
+
+    buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+    sum_ns_.fetch_add(ns, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void append(std::string& out, const std::string& name, const std::string& labels,
+                   double value) {
+    char number[32];
+    std::snprintf(number, sizeof(number), " %.9g\n", value);
+    out += name;
+    if (!labels.empty()) {
+        out += "{" + labels + "}";
+    }
+    out += number;
+}
+
+void Histogram::render(std::string& out, const std::string& name,
+                       const std::string& labels) const {
+    std::string prefix = labels.empty() ? "" : labels + ",";
+
+    // buckets are cumulative in the exposition format
+    unsigned long long cumulative = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        cumulative += buckets_[i].load(std::memory_order_relaxed);
+
+        char bound[32];
+        if (i < HISTOGRAM_BUCKETS - 1) {
+            std::snprintf(bound, sizeof(bound), "%g", BUCKET_BOUNDS[i]);
+        } else {
+            std::snprintf(bound, sizeof(bound), "+Inf");
+        }
+        append(out, name + "_bucket", prefix + "le=\"" + bound + "\"", cumulative);
+    }
+
+    append(out, name + "_sum", labels, sum_ns_.load(std::memory_order_relaxed) * 1e-9);
+    append(out, name + "_count", labels, count_.load(std::memory_order_relaxed));
+}
+
+Metrics& Metrics::instance() {
+    static Metrics metrics;
+    return metrics;
+}
+
+Histogram* Metrics::stage(const std::string& name) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    auto& histogram = stages_[name];
+    if (!histogram) {
+        histogram.reset(new Histogram());
+    }
+    return histogram.get();
+}
+
+Histogram* Metrics::algorithm(const std::string& node, const std::string& resolution) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    auto& histogram = algorithms_[std::make_pair(node, resolution)];
+    if (!histogram) {
+        histogram.reset(new Histogram());
+    }
+    return histogram.get();
+}
+
+void Metrics::add_session(unsigned int id, const SessionMetrics* metrics) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    sessions_[id] = metrics;
+}
+
+void Metrics::remove_session(unsigned int id) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    sessions_.erase(id);
+}
+
+// Prometheus text exposition format 0.0.4
+std::string Metrics::render() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    std::string out;
+
+    out += "# HELP mirlin_stage_duration_seconds Time spent in each stage of a hop.\n"
+           "# TYPE mirlin_stage_duration_seconds histogram\n";
+    for (auto const& iter : stages_) {
+        iter.second->render(out, "mirlin_stage_duration_seconds", "stage=\"" + iter.first + "\"");
+    }
+
+    out += "# HELP mirlin_algorithm_duration_seconds Time spent in each analysis node per frame.\n"
+           "# TYPE mirlin_algorithm_duration_seconds histogram\n";
+    for (auto const& iter : algorithms_) {
+        iter.second->render(out, "mirlin_algorithm_duration_seconds",
+                            "node=\"" + iter.first.first + "\",resolution=\"" +
+                                iter.first.second + "\"");
+    }
+
+    struct SessionSeries {
+        const char* name;
+        const char* type;
+        const char* help;
+        std::atomic<unsigned long> SessionMetrics::*value;
+    };
+    static const SessionSeries series[] = {
+        {"mirlin_session_frames_received_total", "counter", "Audio frames received.",
+         &SessionMetrics::frames_received},
+        {"mirlin_session_samples_dropped_total", "counter",
+         "Samples dropped because the buffer was full.", &SessionMetrics::samples_dropped},
+        {"mirlin_session_samples_skipped_total", "counter",
+         "Samples skipped by the backlog policy.", &SessionMetrics::samples_skipped},
+        {"mirlin_session_hops_analysed_total", "counter", "Hops analysed.",
+         &SessionMetrics::hops_analysed},
+        {"mirlin_session_features_sent_total", "counter", "Feature messages sent.",
+         &SessionMetrics::features_sent},
+        {"mirlin_session_features_dropped_total", "counter",
+         "Feature frames dropped by the delivery policy.", &SessionMetrics::features_dropped},
+        {"mirlin_session_hop_allocations_total", "counter",
+         "Heap allocations made by the analyzer thread while analysing hops.",
+         &SessionMetrics::hop_allocations},
+        {"mirlin_session_serialize_allocations_total", "counter",
+         "Heap allocations made while serialising feature frames.",
+         &SessionMetrics::serialize_allocations},
+        {"mirlin_session_queue_depth", "gauge", "Feature frames waiting for the client.",
+         &SessionMetrics::queue_depth},
+        {"mirlin_session_buffered_samples", "gauge", "Samples waiting to be analysed.",
+         &SessionMetrics::buffered_samples},
+    };
+
+    unsigned int active = 0;
+    for (auto const& session : sessions_) {
+        active += session.second->active.load();
+    }
+    out += "# HELP mirlin_sessions_active Sessions currently analysing audio.\n"
+           "# TYPE mirlin_sessions_active gauge\n";
+    append(out, "mirlin_sessions_active", "", active);
+
+    for (auto const& s : series) {
+        out += std::string("# HELP ") + s.name + " " + s.help + "\n# TYPE " + s.name + " " +
+               s.type + "\n";
+        for (auto const& session : sessions_) {
+            append(out, s.name, "session=\"" + std::to_string(session.first) + "\"",
+                   (session.second->*s.value).load(std::memory_order_relaxed));
+        }
+    }
+
+    return out;
+}
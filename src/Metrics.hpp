@@ -0,0 +1,94 @@
+#ifndef _METRICS
+#define _METRICS
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#define HISTOGRAM_BUCKETS 12
+
+// Durations in seconds, in Prometheus histogram buckets. Observing only touches atomics, so the
+// analyzer threads can time every hop without locks.
+class Histogram {
+public:
+    Histogram();
+
+    void observe(std::chrono::steady_clock::duration duration);
+
+    // Writes the _bucket, _sum and _count samples of the histogram
+    void render(std::string& out, const std::string& name, const std::string& labels) const;
+
+private:
+    std::atomic<unsigned long long> buckets_[HISTOGRAM_BUCKETS];
+    std::atomic<unsigned long long> count_;
+    std::atomic<unsigned long long> sum_ns_;
+};
+
+// Times the enclosing scope into a histogram, NULL disables it
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Histogram* histogram)
+        : histogram_(histogram), start_(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer() {
+        if (histogram_ != NULL) {
+            histogram_->observe(std::chrono::steady_clock::now() - start_);
+        }
+    }
+
+private:
+    Histogram* histogram_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Counters of one analyzer slot. Counters only grow across the sessions the slot serves, gauges
+// describe the current session.
+struct SessionMetrics {
+    std::atomic<bool> active{false};
+    std::atomic<unsigned long> frames_received{0};
+    std::atomic<unsigned long> samples_dropped{0};
+    std::atomic<unsigned long> samples_skipped{0};
+    std::atomic<unsigned long> hops_analysed{0};
+    std::atomic<unsigned long> features_sent{0};
+    std::atomic<unsigned long> features_dropped{0};
+    // heap allocations made analysing hops and serialising their features
+    std::atomic<unsigned long> hop_allocations{0};
+    std::atomic<unsigned long> serialize_allocations{0};
+    // frames waiting for the client
+    std::atomic<unsigned long> queue_depth{0};
+    // samples buffered but not analysed yet
+    std::atomic<unsigned long> buffered_samples{0};
+};
+
+// Process-wide registry of the server's metrics, rendered in the Prometheus text format.
+// Histograms are looked up once, when a pipeline or session is set up, and then observed
+// directly. All methods are safe to call from any thread.
+class Metrics {
+public:
+    static Metrics& instance();
+
+    // Latency of a stage of the hop path: drain, analysis, network, aggregate, serialize, ...
+    Histogram* stage(const std::string& name);
+
+    // Latency of one essentia algorithm of a plan, by node name and resolution
+    Histogram* algorithm(const std::string& node, const std::string& resolution);
+
+    // Sessions must be removed before their metrics are destroyed
+    void add_session(unsigned int id, const SessionMetrics* metrics);
+    void remove_session(unsigned int id);
+
+    std::string render() const;
+
+private:
+    Metrics() {}
+
+    mutable std::mutex mutex_;
+    std::map<std::string, std::unique_ptr<Histogram>> stages_;
+    std::map<std::pair<std::string, std::string>, std::unique_ptr<Histogram>> algorithms_;
+    std::map<unsigned int, const SessionMetrics*> sessions_;
+};
+
+#endif
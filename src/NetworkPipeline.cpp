@@ -0,0 +1,182 @@
+// adapted from:
+// https://github.com/GiantSteps/MC-Sonaar/blob/431048b80b86c29d9caac28ee23061cdf1013b13/essentiaRT~/EssentiaSFX.cpp
+#include <cmath>
+
+#include "NetworkPipeline.hpp"
+
+NetworkPipeline::NetworkPipeline(const PipelineConfig& config)
+    : window_size_(config.window_size()), plan_(FeatureGraph::instance().plan(config)),
+      schema_(plan_, config), onset_slot_(schema_.find("onset")),
+      onset_events_(schema_.find_events("onset")), key_label_(schema_.find_label("key")),
+      scale_label_(schema_.find_label("scale")),
+      network_timer_(Metrics::instance().stage("network")),
+      aggregate_timer_(Metrics::instance().stage("aggregate")) {
+    window_.resize(window_size_);
+
+    // input
+    gen_ = new VectorInput<Real>();
+    gen_->setVector(&window_);
+
+    // setup
+    AlgorithmFactory& factory = AlgorithmFactory::instance();
+
+    frame_cutter_ = factory.create("FrameCutter", "frameSize", window_size_, "hopSize",
+                                   config.hop_size, "startFromZero", true,
+                                   "validFrameThresholdRatio", .1, "lastFrameToEndOfFile", true,
+                                   "silentFrames", "keep");
+    gen_->output("data") >> frame_cutter_->input("signal");
+    algorithms_[FRAME_NODE] = frame_cutter_;
+
+    // create and connect only the nodes the subscription needs, the plan is in dependency order
+    std::map<std::string, std::set<std::string>> consumed;
+    for (auto const& planned : plan_.nodes) {
+        const FeatureNode* node = planned.node;
+
+        // nodes without an algorithm store their input as it is
+        if (node->algorithm.empty()) {
+            const NodeInput& input = node->inputs[0];
+            const std::string source = planned.input_id(input);
+            const std::string& name = node->outputs[0].name;
+            algorithms_[source]->output(input.node_port) >> PC(sfx_pool_, name);
+            consumed[source].insert(input.node_port);
+            continue;
+        }
+
+        streaming::Algorithm* algorithm = factory.create(node->algorithm);
+        algorithm->configure(node->parameters(config, planned.frame_size));
+        algorithms_[planned.id] = algorithm;
+
+        for (auto const& input : node->inputs) {
+            const std::string source = planned.input_id(input);
+            algorithms_[source]->output(input.node_port) >> algorithm->input(input.port);
+            consumed[source].insert(input.node_port);
+        }
+
+        if (node->acquire_size > 0) {
+            algorithm->input(0).setAcquireSize(node->acquire_size);
+            algorithm->input(0).setReleaseSize(node->acquire_size);
+        }
+    }
+
+    // store the outputs, every output the network does not otherwise use must go NOWHERE
+    for (auto const& planned : plan_.nodes) {
+        if (planned.node->algorithm.empty()) {
+            continue;
+        }
+
+        for (auto const& output : planned.node->outputs) {
+            streaming::Algorithm* algorithm = algorithms_[planned.id];
+            if (!output.name.empty()) {
+                Pool& pool = output.aggregated ? sfx_pool_ : onset_pool_;
+                algorithm->output(output.port) >> PC(pool, output.name);
+            } else if (!consumed[planned.id].count(output.port)) {
+                algorithm->output(output.port) >> NOWHERE;
+            }
+        }
+    }
+
+    if (!consumed[FRAME_NODE].count("frame")) {
+        frame_cutter_->output("frame") >> NOWHERE;
+    }
+
+    // Aggregation, over every frame the window is cut into
+    for (auto const& planned : plan_.nodes) {
+        for (auto const& output : planned.node->outputs) {
+            size_t length = output.length(config);
+            if (output.aggregated && !output.name.empty() && length > 0) {
+                outputs_[output.name].configure(
+                    output.name, length, config.memory + 1, config, schema_,
+                    output_scale(output.name, config, planned.frame_size));
+            }
+        }
+    }
+
+    network_ = new scheduler::Network(gen_);
+}
+
+// Deleting the network deletes every algorithm connected to it
+NetworkPipeline::~NetworkPipeline() {
+    delete network_;
+}
+
+void NetworkPipeline::process(const std::vector<Real>& window, FeatureFrame& frame) {
+    // the input only reads from the window while the network runs, so it does not need a copy
+    gen_->setVector(&window);
+    {
+        ScopedTimer timer(network_timer_);
+        gen_->process();
+        network_->run();
+    }
+
+    frame.clear();
+    if (!sfx_pool_.getRealPool().empty() || !sfx_pool_.getVectorRealPool().empty() ||
+        !onset_pool_.getRealPool().empty()) {
+        write(frame);
+    }
+    write_unaggregated(frame);
+    clear();
+}
+
+void NetworkPipeline::reset() { clear(); }
+
+void NetworkPipeline::clear() {
+    network_->reset();
+    frame_cutter_->reset();
+    gen_->setVector(&window_);
+    sfx_pool_.clear();
+    onset_pool_.clear();
+}
+
+// Aggregates the values of every frame in the pools straight into the slots of the frame
+void NetworkPipeline::write(FeatureFrame& frame) {
+    ScopedTimer timer(aggregate_timer_);
+    auto const& reals = sfx_pool_.getRealPool();
+    auto const& vectors = sfx_pool_.getVectorRealPool();
+
+    for (auto& iter : outputs_) {
+        OutputStats& output = iter.second;
+        output.stats.reset();
+
+        auto real = reals.find(iter.first);
+        if (real != reals.end()) {
+            for (Real value : real->second) {
+                output.stats.push(&value, 1);
+            }
+        }
+
+        auto vector = vectors.find(iter.first);
+        if (vector != vectors.end()) {
+            for (auto const& values : vector->second) {
+                output.stats.push(values.data(), values.size());
+            }
+        }
+
+        output.write(frame);
+    }
+}
+
+// Writes the outputs sent as they are: the key of the window's last frame and every onset time
+void NetworkPipeline::write_unaggregated(FeatureFrame& frame) {
+    if (key_label_ >= 0) {
+        auto const& strings = onset_pool_.getStringPool();
+        auto key = strings.find("key");
+        auto scale = strings.find("scale");
+        if (key != strings.end() && !key->second.empty()) {
+            frame.label(key_label_) = key->second.back();
+        }
+        if (scale != strings.end() && !scale->second.empty()) {
+            frame.label(scale_label_) = scale->second.back();
+        }
+    }
+
+    // NaN tells a window without onsets from one with an onset at time 0
+    if (onset_slot_ != NULL) {
+        std::vector<Real>& events = frame.events(onset_events_);
+        auto const& onsets = onset_pool_.getRealPool();
+        auto onset = onsets.find("onset");
+        if (onset != onsets.end()) {
+            events.assign(onset->second.begin(), onset->second.end());
+        }
+        frame.values(*onset_slot_)[0] = events.empty() ? NAN : events[0];
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef _NETWORK_PIPELINE
+#define _NETWORK_PIPELINE
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <essentia/algorithmfactory.h>
+#include <essentia/essentiamath.h>
+#include <essentia/pool.h>
+#include <essentia/streaming/algorithms/vectorinput.h>
+#include <essentia/streaming/streamingalgorithm.h>
+
+#include <essentia/scheduler/network.h>
+#include <essentia/streaming/algorithms/poolstorage.h>
+
+#include "FeatureFrame.hpp"
+#include "FeatureGraph.hpp"
+#include "FeatureSchema.hpp"
+#include "Metrics.hpp"
+#include "Pipeline.hpp"
+
+using namespace essentia;
+using namespace streaming;
+
+// Re-analyses the whole memory window every hop with an essentia streaming network: the window
+// is cut into frames, every frame is described and the results are aggregated into the config's
+// stats.
+class NetworkPipeline : public Pipeline {
+public:
+    explicit NetworkPipeline(const PipelineConfig& config);
+    ~NetworkPipeline();
+
+    void process(const std::vector<Real>& window, FeatureFrame& frame) override;
+
+    void reset() override;
+
+private:
+    void clear();
+    void write(FeatureFrame& frame);
+    void write_unaggregated(FeatureFrame& frame);
+
+    unsigned int window_size_;
+
+    FeaturePlan plan_;
+    FeatureSchema schema_;
+    const FeatureSlot* onset_slot_;
+    int onset_events_;
+    int key_label_;
+    int scale_label_;
+    // by output name
+    std::map<std::string, OutputStats> outputs_;
+
+    std::vector<Real> window_;
+
+    /// ESSENTIA
+    /// algos, by plan node name
+    std::map<std::string, streaming::Algorithm*> algorithms_;
+    streaming::Algorithm* frame_cutter_;
+    //// IO
+    VectorInput<Real>* gen_;
+
+    scheduler::Network* network_ = NULL;
+
+    Pool sfx_pool_;
+    Pool onset_pool_;
+
+    // the scheduler runs the algorithms, so only the whole network is timed
+    Histogram* network_timer_;
+    Histogram* aggregate_timer_;
+};
+
+#endif
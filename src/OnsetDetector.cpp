@@ -0,0 +1,74 @@
+#include <algorithm>
+
+#include "OnsetDetector.hpp"
+
+using essentia::Real;
+
+// novelty below this is silence, however much it exceeds the average
+#define NOVELTY_FLOOR 1e-8
+
+OnsetDetector::OnsetDetector()
+    : threshold_(0), ratio_threshold_(0), pre_max_(1), pre_avg_(1), combine_(0), index_(0),
+      count_(0), detected_(false), since_onset_(0) {
+    novelty_.assign(1, 0);
+}
+
+void OnsetDetector::configure(const essentia::ParameterMap& parameters) {
+    Real frame_rate = parameters["frameRate"].toReal();
+    threshold_ = parameters["threshold"].toReal();
+    ratio_threshold_ = parameters["ratioThreshold"].toReal();
+    pre_max_ = std::max(1, int(frame_rate * parameters["pre_max"].toReal() / 1000));
+    pre_avg_ = std::max(1, int(frame_rate * parameters["pre_avg"].toReal() / 1000));
+    combine_ = frame_rate * parameters["combine"].toReal() / 1000;
+
+    novelty_.assign(std::max(pre_max_, pre_avg_), 0);
+    reset();
+}
+
+void OnsetDetector::reset() {
+    std::fill(novelty_.begin(), novelty_.end(), 0);
+    index_ = novelty_.size() - 1;
+    count_ = 0;
+    detected_ = false;
+    since_onset_ = 0;
+}
+
+bool OnsetDetector::process(Real novelty) {
+    index_ = (index_ + 1) % novelty_.size();
+    novelty_[index_] = novelty;
+    count_ = std::min(count_ + 1, novelty_.size());
+    since_onset_++;
+
+    // the maximum and the moving average both end at the newest frame, values before the first
+    // frame count as 0 like in essentia's filters
+    Real max = 0;
+    Real sum = 0;
+    for (size_t i = 0; i < count_; i++) {
+        Real value = novelty_[(index_ + novelty_.size() - i) % novelty_.size()];
+        if (i < pre_max_) {
+            max = std::max(max, value);
+        }
+        if (i < pre_avg_) {
+            sum += value;
+        }
+    }
+    Real average = sum / pre_avg_;
+
+    if (novelty != max || novelty <= NOVELTY_FLOOR) {
+        return false;
+    }
+
+    bool over_threshold = threshold_ > 0 && novelty > average + threshold_;
+    bool over_ratio = ratio_threshold_ > 0 && average > 0 && novelty / average > ratio_threshold_;
+    if (!over_threshold && !over_ratio) {
+        return false;
+    }
+
+    if (detected_ && since_onset_ <= combine_) {
+        return false;
+    }
+
+    detected_ = true;
+    since_onset_ = 0;
+    return true;
+}
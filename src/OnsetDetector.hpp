@@ -0,0 +1,44 @@
+#ifndef _ONSET_DETECTOR
+#define _ONSET_DETECTOR
+
+#include <vector>
+
+#include <essentia/parameter.h>
+#include <essentia/types.h>
+
+// Causal SuperFlux peak picking that keeps its state across hops, fed one novelty value per hop.
+// It follows essentia's SuperFluxPeaks: a frame is an onset if its novelty is the largest of the
+// last pre_max ms and exceeds the average of the last pre_avg ms by threshold, or by
+// ratioThreshold times, and if it is more than combine ms after the previous onset.
+class OnsetDetector {
+public:
+    OnsetDetector();
+
+    // Takes the parameters of SuperFluxPeaks: frameRate, threshold, ratioThreshold, pre_max,
+    // pre_avg and combine
+    void configure(const essentia::ParameterMap& parameters);
+
+    // Feeds the novelty of the newest frame, returns whether that frame is an onset
+    bool process(essentia::Real novelty);
+
+    // Forgets the novelty history and the last onset
+    void reset();
+
+private:
+    essentia::Real threshold_;
+    essentia::Real ratio_threshold_;
+    // window lengths in frames
+    size_t pre_max_;
+    size_t pre_avg_;
+    double combine_;
+
+    // the last max(pre_max_, pre_avg_) novelty values, newest at index_
+    std::vector<essentia::Real> novelty_;
+    size_t index_;
+    size_t count_;
+    // whether there has been an onset since the last reset, and how many frames ago
+    bool detected_;
+    size_t since_onset_;
+};
+
+#endif
@@ -0,0 +1,24 @@
+#include <algorithm>
+#include <tuple>
+
+#include "Pipeline.hpp"
+
+PipelineConfig::PipelineConfig()
+    : sample_rate(0), hop_size(0), memory(0), streaming(false), stats(DEFAULT_STATS), horizon(0) {}
+
+PipelineConfig::PipelineConfig(unsigned int sample_rate, unsigned int hop_size,
+                               unsigned int memory, const std::vector<std::string>& features,
+                               bool streaming, unsigned int stats, unsigned int horizon)
+    : sample_rate(sample_rate), hop_size(hop_size), memory(memory), features(features),
+      streaming(streaming), stats(stats), horizon(horizon > 0 ? horizon : memory) {
+    // the order features are requested in does not change what gets built
+    std::sort(this->features.begin(), this->features.end());
+    this->features.erase(std::unique(this->features.begin(), this->features.end()),
+                         this->features.end());
+}
+
+bool PipelineConfig::operator<(const PipelineConfig& other) const {
+    return std::tie(sample_rate, hop_size, memory, streaming, stats, horizon, features) <
+           std::tie(other.sample_rate, other.hop_size, other.memory, other.streaming, other.stats,
+                    other.horizon, other.features);
+}
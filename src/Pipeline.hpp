@@ -0,0 +1,53 @@
+#ifndef _PIPELINE
+#define _PIPELINE
+
+#include <string>
+#include <vector>
+
+#include <essentia/types.h>
+
+#include "Features.hpp"
+#include "RunningStats.hpp"
+
+class FeatureFrame;
+
+#define NOVELTY_MULT 1000000
+
+// Everything that determines how a pipeline is built. Pipelines built from equal configs are
+// interchangeable, which is what lets them be cached and reused across sessions.
+struct PipelineConfig {
+    PipelineConfig();
+    PipelineConfig(unsigned int sample_rate, unsigned int hop_size, unsigned int memory,
+                   const std::vector<std::string>& features, bool streaming,
+                   unsigned int stats = DEFAULT_STATS, unsigned int horizon = 0);
+
+    bool operator<(const PipelineConfig& other) const;
+
+    unsigned int window_size() const { return hop_size * memory; }
+
+    unsigned int sample_rate;
+    unsigned int hop_size;
+    unsigned int memory;
+    std::vector<std::string> features; // sorted and without duplicates
+    bool streaming;
+    // mask of the stats aggregated features are reported as
+    unsigned int stats;
+    // hops the stats run over in streaming mode, memory unless set
+    unsigned int horizon;
+};
+
+// Turns the audio of a session into features, one hop at a time
+class Pipeline {
+public:
+    virtual ~Pipeline() {}
+
+    // Analyses the newest hop and writes its features into frame, which is laid out by the
+    // schema of the pipeline's config. window holds the plan's history_size latest samples,
+    // newest last.
+    virtual void process(const std::vector<essentia::Real>& window, FeatureFrame& frame) = 0;
+
+    // Returns the pipeline to the state it was in right after it was built
+    virtual void reset() = 0;
+};
+
+#endif
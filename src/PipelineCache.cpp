@@ -0,0 +1,56 @@
+#include <iostream>
+
+#include "NetworkPipeline.hpp"
+#include "PipelineCache.hpp"
+#include "StreamingPipeline.hpp"
+
+PipelineCache::PipelineCache(size_t max_idle) : max_idle_(max_idle), num_idle_(0) {}
+
+std::unique_ptr<Pipeline> PipelineCache::build(const PipelineConfig& config) {
+    if (config.streaming) {
+        return std::unique_ptr<Pipeline>(new StreamingPipeline(config));
+    }
+    return std::unique_ptr<Pipeline>(new NetworkPipeline(config));
+}
+
+std::unique_ptr<Pipeline> PipelineCache::acquire(const PipelineConfig& config) {
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        auto iter = idle_.find(config);
+        if (iter != idle_.end() && !iter->second.empty()) {
+            std::unique_ptr<Pipeline> pipeline = std::move(iter->second.back());
+            iter->second.pop_back();
+            num_idle_--;
+            return pipeline;
+        }
+    }
+
+    // essentia's algorithm factory is not safe to use from several threads at once
+    static std::mutex build_mutex;
+    std::lock_guard<std::mutex> guard(build_mutex);
+    std::clog << "Building a new analysis pipeline" << std::endl;
+    return build(config);
+}
+
+void PipelineCache::release(const PipelineConfig& config, std::unique_ptr<Pipeline> pipeline) {
+    if (!pipeline) {
+        return;
+    }
+
+    pipeline->reset();
+
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        if (num_idle_ < max_idle_) {
+            idle_[config].push_back(std::move(pipeline));
+            num_idle_++;
+        }
+    }
+
+    // if the cache is full, the pipeline is deleted here, outside of the lock
+}
+
+size_t PipelineCache::num_idle() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return num_idle_;
+}
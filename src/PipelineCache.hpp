@@ -0,0 +1,36 @@
+#ifndef _PIPELINE_CACHE
+#define _PIPELINE_CACHE
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Pipeline.hpp"
+
+// Pool of built pipelines keyed by their config. Sessions check a pipeline out when they start
+// and return it when they end, so reconnecting clients get a reset pipeline instead of paying
+// for building (and leaking) a new one. All methods are safe to call from any thread.
+class PipelineCache {
+public:
+    // Keeps at most max_idle pipelines that are not checked out by a session
+    explicit PipelineCache(size_t max_idle);
+
+    // Returns an idle pipeline built for the config, or builds a new one
+    std::unique_ptr<Pipeline> acquire(const PipelineConfig& config);
+
+    // Resets the pipeline and keeps it for the next session with the same config
+    void release(const PipelineConfig& config, std::unique_ptr<Pipeline> pipeline);
+
+    size_t num_idle();
+
+private:
+    static std::unique_ptr<Pipeline> build(const PipelineConfig& config);
+
+    size_t max_idle_;
+    size_t num_idle_;
+    std::map<PipelineConfig, std::vector<std::unique_ptr<Pipeline>>> idle_;
+    std::mutex mutex_;
+};
+
+#endif
@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <utility>
+
+#include "Resampler.hpp"
+
+// input taps per output sample when the rate is not lowered, lowering it by a factor widens the
+// filter by as much to keep the transition band as narrow relative to the output's Nyquist
+#define BASE_TAPS 48
+// cutoff (-6dB), as a fraction of the lower of the two Nyquist frequencies. With BASE_TAPS the
+// passband is flat up to 0.8 of that Nyquist and the stopband starts just above it.
+#define ROLLOFF 0.9
+// about 90dB of stopband attenuation
+#define KAISER_BETA 8.0
+
+static unsigned int gcd(unsigned int a, unsigned int b) {
+    while (b != 0) {
+        unsigned int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Modified Bessel function of the first kind, of order 0
+static double bessel_i0(double x) {
+    double sum = 1;
+    double term = 1;
+    for (int k = 1; k < 50; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+        if (term < sum * 1e-12) {
+            break;
+        }
+    }
+    return sum;
+}
+
+PolyphaseFilter::PolyphaseFilter(unsigned int interpolation, unsigned int decimation)
+    : interpolation_(interpolation), decimation_(decimation) {
+    double ratio = static_cast<double>(decimation) / interpolation;
+    taps_ = static_cast<size_t>(std::ceil(BASE_TAPS * std::max(1.0, ratio)));
+
+    // the prototype runs at the interpolated rate, where the cutoff is the lower Nyquist
+    size_t length = taps_ * interpolation;
+    double cutoff = ROLLOFF * 0.5 / std::max(interpolation, decimation);
+    double center = (length - 1) / 2.0;
+    double i0_beta = bessel_i0(KAISER_BETA);
+
+    std::vector<double> prototype(length);
+    for (size_t i = 0; i < length; i++) {
+        double x = i - center;
+        double sinc = x == 0 ? 1 : std::sin(2 * M_PI * cutoff * x) / (2 * M_PI * cutoff * x);
+        double r = length > 1 ? 2.0 * i / (length - 1) - 1 : 0;
+        double window = bessel_i0(KAISER_BETA * std::sqrt(std::max(0.0, 1 - r * r))) / i0_beta;
+        prototype[i] = sinc * window;
+    }
+
+    // phase p weighs input sample i0 - k by prototype[p + k * interpolation]. Every phase is
+    // normalised to unity gain at DC, so a constant signal stays constant whatever the phase.
+    coefficients_.resize(length);
+    for (unsigned int p = 0; p < interpolation; p++) {
+        double sum = 0;
+        for (size_t k = 0; k < taps_; k++) {
+            sum += prototype[p + k * interpolation];
+        }
+        for (size_t k = 0; k < taps_; k++) {
+            coefficients_[p * taps_ + taps_ - 1 - k] =
+                static_cast<float>(prototype[p + k * interpolation] / sum);
+        }
+    }
+}
+
+bool Resampler::supported(unsigned int input_rate, unsigned int output_rate) {
+    return input_rate > 0 && output_rate > 0 &&
+           output_rate / gcd(input_rate, output_rate) <= MAX_RESAMPLER_PHASES;
+}
+
+// Filter banks are built once per pair of rates and live as long as the process, there are only
+// as many as there are client rates in use
+std::shared_ptr<const PolyphaseFilter> Resampler::filter(unsigned int interpolation,
+                                                         unsigned int decimation) {
+    static std::map<std::pair<unsigned int, unsigned int>, std::shared_ptr<const PolyphaseFilter>>
+        filters;
+    static std::mutex mutex;
+
+    std::lock_guard<std::mutex> guard(mutex);
+    auto& filter = filters[std::make_pair(interpolation, decimation)];
+    if (!filter) {
+        filter = std::make_shared<PolyphaseFilter>(interpolation, decimation);
+    }
+    return filter;
+}
+
+Resampler::Resampler(unsigned int input_rate, unsigned int output_rate, unsigned int channels)
+    : channels_(std::max(1u, channels)), position_(0), phase_(0), history_(channels_) {
+    unsigned int divisor = gcd(input_rate, output_rate);
+    filter_ = filter(output_rate / divisor, input_rate / divisor);
+    reset();
+}
+
+float* Resampler::input(size_t count) {
+    if (input_.size() < count) {
+        input_.resize(count);
+    }
+    return input_.data();
+}
+
+size_t Resampler::process(size_t frames) {
+    size_t taps = filter_->taps();
+    unsigned int interpolation = filter_->interpolation();
+    unsigned int decimation = filter_->decimation();
+
+    size_t max_output = frames * interpolation / decimation + 1;
+    if (output_.size() < max_output * channels_) {
+        output_.resize(max_output * channels_);
+    }
+
+    size_t produced = 0;
+    size_t position = position_;
+    unsigned int phase = phase_;
+    for (unsigned int channel = 0; channel < channels_; channel++) {
+        // the channel's frame goes after its history, so every output reads contiguous samples
+        std::vector<float>& history = history_[channel];
+        if (history.size() < taps - 1 + frames) {
+            history.resize(taps - 1 + frames);
+        }
+        const float* in = input_.data() + channel;
+        for (size_t i = 0; i < frames; i++) {
+            history[taps - 1 + i] = in[i * channels_];
+        }
+
+        // every channel steps through the same positions and phases
+        position = position_;
+        phase = phase_;
+        produced = 0;
+        float* out = output_.data() + channel;
+        while (position < frames) {
+            const float* coefficients = filter_->phase(phase);
+            const float* samples = history.data() + position;
+            float sum = 0;
+            for (size_t j = 0; j < taps; j++) {
+                sum += coefficients[j] * samples[j];
+            }
+            out[produced * channels_] = sum;
+            produced++;
+
+            phase += decimation;
+            position += phase / interpolation;
+            phase %= interpolation;
+        }
+
+        // the latest taps - 1 samples are the history of the next frame
+        std::copy(history.begin() + frames, history.begin() + frames + taps - 1, history.begin());
+    }
+
+    position_ = position - frames;
+    phase_ = phase;
+    return produced;
+}
+
+void Resampler::reset() {
+    position_ = 0;
+    phase_ = 0;
+    for (auto& history : history_) {
+        history.assign(filter_->taps() - 1, 0);
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef _RESAMPLER
+#define _RESAMPLER
+
+#include <memory>
+#include <vector>
+
+// ratios whose reduced interpolation factor is larger are not resampled, their filter banks
+// would take megabytes
+#define MAX_RESAMPLER_PHASES 4096
+
+// The Kaiser windowed sinc low-pass of a rational resampling by interpolation / decimation,
+// split into its interpolation phases. A filter bank never changes once built, so one is shared
+// by every session that converts between the same two rates.
+class PolyphaseFilter {
+public:
+    PolyphaseFilter(unsigned int interpolation, unsigned int decimation);
+
+    unsigned int interpolation() const { return interpolation_; }
+    unsigned int decimation() const { return decimation_; }
+
+    // Input samples each output sample is computed from
+    size_t taps() const { return taps_; }
+
+    // The taps of a phase, oldest input sample first
+    const float* phase(unsigned int index) const { return &coefficients_[index * taps_]; }
+
+private:
+    unsigned int interpolation_;
+    unsigned int decimation_;
+    size_t taps_;
+    std::vector<float> coefficients_;
+};
+
+// Converts interleaved audio from one sample rate to another, one frame at a time, keeping the
+// filter's history and phase across frames so that the output is continuous. The buffers grow
+// to the largest frame seen and are then reused, so steady-state frames allocate nothing.
+class Resampler {
+public:
+    Resampler(unsigned int input_rate, unsigned int output_rate, unsigned int channels);
+
+    // Whether the rates can be converted, see MAX_RESAMPLER_PHASES
+    static bool supported(unsigned int input_rate, unsigned int output_rate);
+
+    // Room for count interleaved input samples, to be filled before process()
+    float* input(size_t count);
+
+    // Resamples the frames (samples per channel) of input() and returns the number of frames
+    // written to output()
+    size_t process(size_t frames);
+    const float* output() const { return output_.data(); }
+
+    // Forgets the history, as if no audio had been processed
+    void reset();
+
+private:
+    static std::shared_ptr<const PolyphaseFilter> filter(unsigned int interpolation,
+                                                         unsigned int decimation);
+
+    std::shared_ptr<const PolyphaseFilter> filter_;
+    unsigned int channels_;
+    // the next output sample reads the taps() input samples ending at position_, relative to
+    // the first sample of the next frame, through phase phase_
+    size_t position_;
+    unsigned int phase_;
+
+    std::vector<float> input_;
+    std::vector<float> output_;
+    // per channel: the taps() - 1 latest samples of the previous frames, then the frame
+    std::vector<std::vector<float>> history_;
+};
+
+#endif
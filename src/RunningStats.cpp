@@ -0,0 +1,199 @@
+#include <algorithm>
+
+#include "RunningStats.hpp"
+
+using essentia::Real;
+
+const Stat ALL_STATS[5] = {STAT_MEAN, STAT_VAR, STAT_MIN, STAT_MAX, STAT_EMA};
+
+const char* stat_name(Stat stat) {
+    switch (stat) {
+    case STAT_MEAN:
+        return "mean";
+    case STAT_VAR:
+        return "var";
+    case STAT_MIN:
+        return "min";
+    case STAT_MAX:
+        return "max";
+    case STAT_EMA:
+        return "ema";
+    }
+    return "";
+}
+
+unsigned int parse_stat(const std::string& name) {
+    for (auto stat : ALL_STATS) {
+        if (name == stat_name(stat)) {
+            return stat;
+        }
+    }
+    return 0;
+}
+
+void RunningStats::Queues::allocate(size_t length, size_t horizon) {
+    rows.assign(length * horizon, 0);
+    head.assign(length, 0);
+    size.assign(length, 0);
+}
+
+void RunningStats::Queues::clear() {
+    std::fill(head.begin(), head.end(), 0);
+    std::fill(size.begin(), size.end(), 0);
+}
+
+RunningStats::RunningStats() { configure(0, 1, 0); }
+
+void RunningStats::configure(size_t length, size_t horizon, unsigned int stats) {
+    length_ = length;
+    horizon_ = std::max<size_t>(horizon, 1);
+    stats_ = stats;
+    alpha_ = 2.0 / (horizon_ + 1);
+
+    values_.assign(length_ * horizon_, 0);
+    sum_.assign(length_, 0);
+    sum_squares_.assign(length_, 0);
+    ema_.assign(length_, 0);
+
+    max_.allocate(stats_ & STAT_MAX ? length_ : 0, horizon_);
+    min_.allocate(stats_ & STAT_MIN ? length_ : 0, horizon_);
+
+    reset();
+}
+
+void RunningStats::reset() {
+    index_ = horizon_ - 1;
+    count_ = 0;
+    std::fill(sum_.begin(), sum_.end(), 0);
+    std::fill(sum_squares_.begin(), sum_squares_.end(), 0);
+    std::fill(ema_.begin(), ema_.end(), 0);
+    max_.clear();
+    min_.clear();
+}
+
+// Drops the row about to be overwritten from the front of the queue, where it is if it is there
+// at all: it is the oldest row in the window
+void RunningStats::evict(Queues& queues, size_t element, size_t row) {
+    uint32_t& head = queues.head[element];
+    uint32_t& size = queues.size[element];
+    if (size > 0 && queues.rows[element * horizon_ + head] == row) {
+        head = (head + 1) % horizon_;
+        size--;
+    }
+}
+
+// Appends a row, first dropping the rows it dominates from the back of the queue
+void RunningStats::enqueue(Queues& queues, size_t element, size_t row, bool keep_larger) {
+    uint32_t* rows = &queues.rows[element * horizon_];
+    uint32_t head = queues.head[element];
+    uint32_t& size = queues.size[element];
+    Real x = value(row, element);
+
+    while (size > 0) {
+        Real back = value(rows[(head + size - 1) % horizon_], element);
+        if (keep_larger ? back > x : back < x) {
+            break;
+        }
+        size--;
+    }
+
+    rows[(head + size) % horizon_] = row;
+    size++;
+}
+
+void RunningStats::push(const Real* values, size_t n) {
+    size_t row = (index_ + 1) % horizon_;
+    bool evicting = count_ == horizon_;
+    bool sums = stats_ & (STAT_MEAN | STAT_VAR);
+    Real* out = &values_[row * length_];
+
+    for (size_t j = 0; j < length_; j++) {
+        // read before the row is overwritten, values may point into it (see repeat())
+        Real x = j < n ? values[j] : 0;
+
+        if (evicting) {
+            Real old = out[j];
+            if (sums) {
+                sum_[j] -= old;
+                sum_squares_[j] -= double(old) * old;
+            }
+            if (stats_ & STAT_MAX) {
+                evict(max_, j, row);
+            }
+            if (stats_ & STAT_MIN) {
+                evict(min_, j, row);
+            }
+        }
+
+        out[j] = x;
+
+        if (sums) {
+            sum_[j] += x;
+            sum_squares_[j] += double(x) * x;
+        }
+        if (stats_ & STAT_MAX) {
+            enqueue(max_, j, row, true);
+        }
+        if (stats_ & STAT_MIN) {
+            enqueue(min_, j, row, false);
+        }
+        if (stats_ & STAT_EMA) {
+            ema_[j] = count_ == 0 ? x : ema_[j] + alpha_ * (x - ema_[j]);
+        }
+    }
+
+    index_ = row;
+    count_ = std::min(count_ + 1, horizon_);
+
+    // once per lap, so that the rounding errors of the running sums cannot build up
+    if (evicting && row == 0 && sums) {
+        recompute_sums();
+    }
+}
+
+void RunningStats::repeat() {
+    if (count_ > 0) {
+        push(&values_[index_ * length_], length_);
+    }
+}
+
+void RunningStats::recompute_sums() {
+    std::fill(sum_.begin(), sum_.end(), 0);
+    std::fill(sum_squares_.begin(), sum_squares_.end(), 0);
+    for (size_t row = 0; row < count_; row++) {
+        for (size_t j = 0; j < length_; j++) {
+            double x = value(row, j);
+            sum_[j] += x;
+            sum_squares_[j] += x * x;
+        }
+    }
+}
+
+void RunningStats::write(Stat stat, Real* out, Real scale) const {
+    if (count_ == 0 || !(stats_ & stat)) {
+        std::fill(out, out + length_, 0);
+        return;
+    }
+
+    for (size_t j = 0; j < length_; j++) {
+        double mean = sum_[j] / count_;
+        switch (stat) {
+        case STAT_MEAN:
+            out[j] = mean * scale;
+            break;
+        case STAT_VAR:
+            // the running sums can leave a tiny negative variance behind
+            out[j] = std::max(0.0, sum_squares_[j] / count_ - mean * mean) * scale * scale;
+            break;
+        case STAT_MIN:
+            out[j] = value(min_.rows[j * horizon_ + min_.head[j]], j) * scale;
+            break;
+        case STAT_MAX:
+            out[j] = value(max_.rows[j * horizon_ + max_.head[j]], j) * scale;
+            break;
+        case STAT_EMA:
+            out[j] = ema_[j] * scale;
+            break;
+        }
+    }
+}
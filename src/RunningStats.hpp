@@ -0,0 +1,89 @@
+#ifndef _RUNNING_STATS
+#define _RUNNING_STATS
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <essentia/types.h>
+
+// Statistics the values of aggregated features can be reported as, combined into a bit mask
+enum Stat { STAT_MEAN = 1, STAT_VAR = 2, STAT_MIN = 4, STAT_MAX = 8, STAT_EMA = 16 };
+
+#define DEFAULT_STATS (STAT_MEAN | STAT_VAR)
+
+// every stat, in the order they are laid out in
+extern const Stat ALL_STATS[5];
+
+// Name of a stat in feature names, e.g. "mean" in "rms.mean"
+const char* stat_name(Stat stat);
+
+// Stat of a name, 0 if there is none
+unsigned int parse_stat(const std::string& name);
+
+// Sliding-window statistics of a vector of values, updated in O(length) per push: the mean and
+// (population) variance come from running sums, the minimum and maximum from monotonic queues,
+// and the exponential moving average has a time constant of about `horizon` pushes. Only the
+// requested stats are maintained.
+class RunningStats {
+public:
+    RunningStats();
+
+    // Keeps stats over the last `horizon` pushes of `length` values, and forgets all history
+    void configure(size_t length, size_t horizon, unsigned int stats);
+
+    // Adds the newest values, values beyond n count as 0
+    void push(const essentia::Real* values, size_t n);
+
+    // Adds the newest values again, nothing if there are none
+    void repeat();
+
+    void reset();
+
+    size_t count() const { return count_; }
+
+    // Writes length() values of a stat, multiplied by scale (scale squared for the variance)
+    void write(Stat stat, essentia::Real* out, essentia::Real scale) const;
+
+    size_t length() const { return length_; }
+
+private:
+    // the monotonic queue of one element, stored in a horizon_ sized slice of a flat vector
+    struct Queues {
+        std::vector<uint32_t> rows;
+        std::vector<uint32_t> head;
+        std::vector<uint32_t> size;
+
+        void allocate(size_t length, size_t horizon);
+        void clear();
+    };
+
+    essentia::Real value(size_t row, size_t element) const {
+        return values_[row * length_ + element];
+    }
+
+    void recompute_sums();
+    void evict(Queues& queues, size_t element, size_t row);
+    void enqueue(Queues& queues, size_t element, size_t row, bool keep_larger);
+
+    size_t length_;
+    size_t horizon_;
+    unsigned int stats_;
+
+    // the last horizon_ pushes, row by row, the newest at index_
+    std::vector<essentia::Real> values_;
+    size_t index_;
+    size_t count_;
+
+    std::vector<double> sum_;
+    std::vector<double> sum_squares_;
+
+    // per element, the rows whose values are decreasing (max) or increasing (min)
+    Queues max_;
+    Queues min_;
+
+    double alpha_;
+    std::vector<double> ema_;
+};
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef _SAMPLE_RING
+#define _SAMPLE_RING
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Preallocated single-producer/single-consumer ring buffer of audio samples, or of anything else
+// that is copyable. One thread may write and one other thread may read concurrently without
+// locking. The capacity is rounded up to a power of two and never changes after allocate().
+template <typename T> class SpscRing {
+public:
+    SpscRing() : mask_(0), head_(0), tail_(0) {}
+
+    // Allocates room for at least min_capacity elements and empties the ring.
+    // Not thread safe: call before the producer and consumer start.
+    void allocate(size_t min_capacity) {
+        size_t capacity = 1;
+        while (capacity < min_capacity) {
+            capacity <<= 1;
+        }
+        buffer_.assign(capacity, T());
+        mask_ = capacity - 1;
+        head_.store(0);
+        tail_.store(0);
+    }
+
+    size_t capacity() const { return buffer_.size(); }
+
+    // Number of elements waiting to be read. tail_ is loaded first so that the result cannot
+    // underflow when called from a third thread.
+    size_t size() const {
+        size_t tail = tail_.load(std::memory_order_acquire);
+        return head_.load(std::memory_order_acquire) - tail;
+    }
+
+    bool empty() const { return size() == 0; }
+
+    // Producer: appends count elements produced by writer(T* out, size_t first, size_t n),
+    // which must fill out with elements [first, first + n) of the input. The writer is called once,
+    // or twice when the elements wrap around the end of the buffer. Nothing is written and false
+    // is returned if there is not enough free space.
+    template <typename Writer> bool write(size_t count, Writer writer) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t tail = tail_.load(std::memory_order_acquire);
+        if (count > capacity() - (head - tail)) {
+            return false;
+        }
+
+        size_t start = head & mask_;
+        size_t first = std::min(count, capacity() - start);
+        writer(&buffer_[start], 0, first);
+        if (first < count) {
+            writer(&buffer_[0], first, count - first);
+        }
+
+        head_.store(head + count, std::memory_order_release);
+        return true;
+    }
+
+    bool write(const T* values, size_t count) {
+        return write(count, [values](T* out, size_t first, size_t n) {
+            std::copy(values + first, values + first + n, out);
+        });
+    }
+
+    // Consumer: copies the oldest element into out without removing it, false if empty
+    bool peek(T& out) const {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (head_.load(std::memory_order_acquire) == tail) {
+            return false;
+        }
+        out = buffer_[tail & mask_];
+        return true;
+    }
+
+    // Consumer: discards up to count of the oldest elements, returns the number discarded
+    size_t skip(size_t count) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t n = std::min(count, head_.load(std::memory_order_acquire) - tail);
+        tail_.store(tail + n, std::memory_order_release);
+        return n;
+    }
+
+    // Consumer: moves up to count of the oldest elements into out, returns the number read
+    size_t read(T* out, size_t count) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t n = std::min(count, head_.load(std::memory_order_acquire) - tail);
+
+        size_t start = tail & mask_;
+        size_t first = std::min(n, capacity() - start);
+        std::copy(buffer_.begin() + start, buffer_.begin() + start + first, out);
+        std::copy(buffer_.begin(), buffer_.begin() + (n - first), out + first);
+
+        tail_.store(tail + n, std::memory_order_release);
+        return n;
+    }
+
+private:
+    std::vector<T> buffer_;
+    size_t mask_;
+
+    // head_ is only written by the producer and tail_ only by the consumer. Both increase
+    // monotonically and are masked when indexing, so head_ - tail_ is always the fill level.
+    std::atomic<size_t> head_;
+    std::atomic<size_t> tail_;
+};
+
+typedef SpscRing<float> SampleRing;
+
+#endif
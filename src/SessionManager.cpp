@@ -0,0 +1,94 @@
+#include "SessionManager.hpp"
+
+SessionManager::SessionManager(size_t max_sessions)
+    : max_sessions_(max_sessions), next_id_(1), pipelines_(max_sessions) {}
+
+SessionManager::~SessionManager() { end_all(); }
+
+void SessionManager::prune(std::vector<Session>& ended) {
+    for (auto it = sessions_.begin(); it != sessions_.end();) {
+        if (!it->second->is_busy()) {
+            ended.push_back(it->second);
+            it = sessions_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+Session SessionManager::create_session(ClientConnection conn) {
+    // sessions are ended outside of the lock since ending joins the analyzer's threads
+    std::vector<Session> ended;
+    Session session;
+
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+
+        auto existing = sessions_.find(conn);
+        if (existing != sessions_.end()) {
+            ended.push_back(existing->second);
+            sessions_.erase(existing);
+        }
+
+        if (sessions_.size() >= max_sessions_) {
+            prune(ended);
+        }
+
+        if (sessions_.size() < max_sessions_) {
+            session = std::make_shared<Analyzer>(next_id_++, pipelines_);
+            session->handle_features(feature_handler_);
+            sessions_[conn] = session;
+        }
+    }
+
+    for (auto& s : ended) {
+        s->end_session();
+    }
+
+    return session;
+}
+
+Session SessionManager::get_session(ClientConnection conn) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    auto it = sessions_.find(conn);
+    if (it == sessions_.end()) {
+        return nullptr;
+    }
+    return it->second;
+}
+
+bool SessionManager::has_session(ClientConnection conn) { return get_session(conn) != nullptr; }
+
+void SessionManager::end_session(ClientConnection conn) {
+    Session session;
+
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        auto it = sessions_.find(conn);
+        if (it == sessions_.end()) {
+            return;
+        }
+        session = it->second;
+        sessions_.erase(it);
+    }
+
+    session->end_session();
+}
+
+void SessionManager::end_all() {
+    std::map<ClientConnection, Session, std::owner_less<ClientConnection>> sessions;
+
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        sessions.swap(sessions_);
+    }
+
+    for (auto& iter : sessions) {
+        iter.second->end_session();
+    }
+}
+
+size_t SessionManager::num_sessions() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return sessions_.size();
+}
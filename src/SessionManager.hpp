@@ -0,0 +1,60 @@
+#ifndef _SESSION_MANAGER
+#define _SESSION_MANAGER
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "Analyzer.hpp"
+#include "WebsocketServer.hpp"
+
+typedef std::shared_ptr<Analyzer> Session;
+
+// Owns one Analyzer per client connection so that every connection gets its own isolated
+// analysis state. All public methods are safe to call from any thread.
+class SessionManager {
+public:
+    explicit SessionManager(size_t max_sessions);
+    ~SessionManager();
+
+    // Creates a new session for the connection, replacing any session it already had.
+    // Returns nullptr if the maximum number of concurrent sessions has been reached.
+    Session create_session(ClientConnection conn);
+
+    // Returns the session owned by the connection, or nullptr if there is none
+    Session get_session(ClientConnection conn);
+
+    bool has_session(ClientConnection conn);
+
+    // Ends and removes the connection's session, if any
+    void end_session(ClientConnection conn);
+
+    // Ends and removes every session
+    void end_all();
+
+    size_t num_sessions();
+
+    size_t max_sessions() const { return max_sessions_; }
+
+    // Registers the callback installed on every new session's analyzer
+    template <typename FeaturesCallback> void handle_features(FeaturesCallback handler) {
+        std::lock_guard<std::mutex> guard(mutex_);
+        feature_handler_ = handler;
+    }
+
+private:
+    // Drops sessions whose analyzer has stopped on its own (timed out). Requires mutex_.
+    void prune(std::vector<Session>& ended);
+
+    size_t max_sessions_;
+    unsigned int next_id_;
+    // declared before sessions_ so that it outlives them
+    PipelineCache pipelines_;
+    std::map<ClientConnection, Session, std::owner_less<ClientConnection>> sessions_;
+    std::function<void(ClientConnection, unsigned int, std::shared_ptr<FeatureFrame>)>
+        feature_handler_;
+    std::mutex mutex_;
+};
+
+#endif
@@ -0,0 +1,496 @@
+#include <algorithm>
+#include <cmath>
+
+#include "StreamingPipeline.hpp"
+
+StreamingPipeline::Node* StreamingPipeline::Nodes::find(const std::string& name) {
+    static const std::pair<const char*, Node Nodes::*> nodes[] = {
+        {"windowing", &Nodes::windowing},
+        {"fft", &Nodes::fft},
+        {"spectral_peaks", &Nodes::spectral_peaks},
+        {"triangle_bands", &Nodes::triangle_bands},
+        {"hpcp", &Nodes::hpcp},
+        {"super_flux_novelty", &Nodes::super_flux_novelty},
+        {"spectrum", &Nodes::spectrum},
+        {"rms", &Nodes::rms},
+        {"energy", &Nodes::energy},
+        {"centroid", &Nodes::centroid},
+        {"loudness", &Nodes::loudness},
+        {"noisiness", &Nodes::noisiness},
+        {"pitch", &Nodes::pitch},
+        {"mfcc", &Nodes::mfcc},
+        {"dissonance", &Nodes::dissonance},
+        {"key", &Nodes::key},
+        {"tristimulus", &Nodes::tristimulus},
+        {"spectral_contrast", &Nodes::spectral_contrast},
+        {"spectral_complexity", &Nodes::spectral_complexity},
+        {"chroma", &Nodes::chroma},
+        {"onset", &Nodes::onset},
+    };
+
+    for (auto const& node : nodes) {
+        if (name == node.first) {
+            return &(this->*node.second);
+        }
+    }
+    return NULL;
+}
+
+StreamingPipeline::StreamingPipeline(const PipelineConfig& config)
+    : sample_rate_(config.sample_rate), hop_size_(config.hop_size),
+      plan_(FeatureGraph::instance().plan(config)), schema_(plan_, config),
+      onset_slot_(schema_.find("onset")), onset_events_(schema_.find_events("onset")),
+      key_label_(schema_.find_label("key")), scale_label_(schema_.find_label("scale")),
+      hop_count_(0),
+      aggregate_timer_(Metrics::instance().stage("aggregate")), real_(0), real2_(0) {
+    standard::AlgorithmFactory& factory = standard::AlgorithmFactory::instance();
+
+    // create only the nodes the subscription needs, grouped by the resolution they run at
+    for (auto const& planned : plan_.nodes) {
+        const FeatureNode* node = planned.node;
+        Stage& stage = stages_[planned.resolution];
+        stage.frame_size = planned.frame_size;
+        stage.interval = planned.interval;
+        stage.frame_kernel |= node->kernel == KERNEL_FRAME;
+        stage.spectrum_kernel |= node->kernel == KERNEL_SPECTRUM;
+
+        // nodes this analysis has no code for are not computed
+        Node* resolved = stage.nodes.find(node->name);
+        if (resolved == NULL) {
+            continue;
+        }
+        resolved->planned = true;
+
+        // the running stats of every aggregated output and the slots they are written to
+        for (auto const& output : node->outputs) {
+            size_t length = output.length(config);
+            if (!output.aggregated || output.name.empty() || length == 0) {
+                continue;
+            }
+
+            OutputStats& stats = outputs_[output.name];
+            stats.configure(output.name, length, config.horizon, config, schema_,
+                            output_scale(output.name, config, planned.frame_size));
+            stage.outputs.push_back(&stats);
+            resolved->outputs.push_back(&stats);
+        }
+
+        // nodes computed by the fused kernels have no algorithm of their own
+        if (node->algorithm.empty() || node->kernel != KERNEL_NONE) {
+            continue;
+        }
+        resolved->timer =
+            Metrics::instance().algorithm(node->name, resolution_name(planned.resolution));
+
+        // onsets are picked by a detector that keeps the novelty history across hops
+        if (node->name == "onset") {
+            onset_detector_.configure(node->parameters(config, planned.frame_size));
+            continue;
+        }
+
+        standard::Algorithm* algorithm = factory.create(node->algorithm);
+        algorithm->configure(node->parameters(config, planned.frame_size));
+        resolved->algorithm = algorithm;
+        stage.algorithms.push_back(algorithm);
+    }
+
+    for (auto& iter : stages_) {
+        Stage& stage = iter.second;
+        const char* resolution = resolution_name(iter.first);
+        stage.frame.assign(stage.frame_size, 0);
+        if (stage.frame_kernel || stage.nodes.fft.planned) {
+            stage.window = FftCache::instance().window(
+                FeatureGraph::instance().node("windowing")->parameters(config, stage.frame_size),
+                stage.frame_size);
+        }
+        if (stage.nodes.fft.planned) {
+            stage.fft = FftCache::instance().fft(stage.frame_size);
+            if (stage.fft) {
+                stage.fft_workspace.resize(stage.fft->workspace_size());
+            } else {
+                // sizes with a large prime factor go through essentia's FFT, windowed here
+                const FeatureNode* fft = FeatureGraph::instance().node("fft");
+                standard::Algorithm* spectrum = factory.create(fft->algorithm);
+                spectrum->configure(fft->parameters(config, stage.frame_size));
+                stage.nodes.fft.algorithm = spectrum;
+                stage.algorithms.push_back(spectrum);
+                stage.fft_frame.assign(stage.frame_size, 0);
+            }
+            stage.spectrum.resize(stage.frame_size / 2 + 1);
+            stage.nodes.fft.timer = Metrics::instance().algorithm("fft", resolution);
+        }
+        if (stage.frame_kernel) {
+            stage.frame_kernel_timer = Metrics::instance().algorithm("frame_kernel", resolution);
+        }
+        if (stage.spectrum_kernel) {
+            stage.spectrum_kernel_timer =
+                Metrics::instance().algorithm("spectrum_kernel", resolution);
+        }
+        bind(stage);
+    }
+}
+
+// Binds the buffers shared between the nodes of a stage and the buffers their per-hop results are
+// read from, once, so that hops neither look ports up nor allocate
+void StreamingPipeline::bind(Stage& stage) {
+    Nodes& nodes = stage.nodes;
+    if (nodes.windowing.planned) {
+        nodes.windowing.algorithm->input("frame").set(stage.frame);
+        nodes.windowing.algorithm->output("frame").set(stage.windowed);
+    }
+
+    if (nodes.fft.planned && !stage.fft) {
+        nodes.fft.algorithm->input("frame").set(stage.fft_frame);
+        nodes.fft.algorithm->output("spectrum").set(stage.spectrum);
+    }
+
+    if (nodes.spectral_peaks.planned) {
+        standard::Algorithm* peaks = nodes.spectral_peaks.algorithm;
+        peaks->input("spectrum").set(stage.spectrum);
+        peaks->output("frequencies").set(stage.frequencies);
+        peaks->output("magnitudes").set(stage.magnitudes);
+    }
+
+    // the bands of the previous hop are swapped into bands[0], the vectors stay in place
+    if (nodes.triangle_bands.planned) {
+        stage.bands.resize(2);
+        nodes.triangle_bands.algorithm->input("spectrum").set(stage.spectrum);
+        nodes.triangle_bands.algorithm->output("bands").set(stage.bands[1]);
+    }
+
+    if (nodes.hpcp.planned) {
+        standard::Algorithm* hpcp = nodes.hpcp.algorithm;
+        hpcp->input("frequencies").set(stage.frequencies);
+        hpcp->input("magnitudes").set(stage.magnitudes);
+        hpcp->output("hpcp").set(stage.hpcp);
+    }
+
+    if (nodes.super_flux_novelty.planned) {
+        nodes.super_flux_novelty.algorithm->input("bands").set(stage.bands);
+        nodes.super_flux_novelty.algorithm->output("differences").set(real_);
+    }
+
+    Node* spectrum_inputs[] = {&nodes.pitch, &nodes.mfcc, &nodes.spectral_contrast,
+                               &nodes.spectral_complexity};
+    for (auto node : spectrum_inputs) {
+        if (node->planned) {
+            node->algorithm->input("spectrum").set(stage.spectrum);
+        }
+    }
+
+    if (nodes.chroma.planned) {
+        nodes.chroma.algorithm->input("frame").set(stage.windowed);
+    }
+
+    Node* peak_inputs[] = {&nodes.dissonance, &nodes.tristimulus};
+    for (auto node : peak_inputs) {
+        if (node->planned) {
+            node->algorithm->input("frequencies").set(stage.frequencies);
+            node->algorithm->input("magnitudes").set(stage.magnitudes);
+        }
+    }
+
+    if (nodes.key.planned) {
+        standard::Algorithm* key = nodes.key.algorithm;
+        key->input("pcp").set(stage.hpcp);
+        key->output("key").set(key_);
+        key->output("scale").set(scale_);
+        key->output("strength").set(real_);
+    }
+
+    // results are stored as soon as their algorithm has run, so stages share these buffers
+    if (nodes.pitch.planned) {
+        nodes.pitch.algorithm->output("pitch").set(real_);
+        nodes.pitch.algorithm->output("pitchConfidence").set(real2_);
+    }
+
+    if (nodes.mfcc.planned) {
+        nodes.mfcc.algorithm->output("bands").set(value2_);
+        nodes.mfcc.algorithm->output("mfcc").set(value_);
+    }
+
+    if (nodes.dissonance.planned) {
+        nodes.dissonance.algorithm->output("dissonance").set(real_);
+    }
+
+    if (nodes.tristimulus.planned) {
+        nodes.tristimulus.algorithm->output("tristimulus").set(value_);
+    }
+
+    if (nodes.spectral_contrast.planned) {
+        nodes.spectral_contrast.algorithm->output("spectralContrast").set(value_);
+        nodes.spectral_contrast.algorithm->output("spectralValley").set(value2_);
+    }
+
+    if (nodes.spectral_complexity.planned) {
+        nodes.spectral_complexity.algorithm->output("spectralComplexity").set(real_);
+    }
+
+    if (nodes.chroma.planned) {
+        nodes.chroma.algorithm->output("chromagram").set(value_);
+    }
+}
+
+StreamingPipeline::~StreamingPipeline() {
+    for (auto& stage : stages_) {
+        for (auto algorithm : stage.second.algorithms) {
+            delete algorithm;
+        }
+    }
+}
+
+void StreamingPipeline::reset() {
+    for (auto& iter : stages_) {
+        Stage& stage = iter.second;
+        for (auto algorithm : stage.algorithms) {
+            algorithm->reset();
+        }
+        for (auto& b : stage.bands) {
+            b.clear();
+        }
+    }
+
+    for (auto& iter : outputs_) {
+        iter.second.stats.reset();
+    }
+    hop_count_ = 0;
+    onset_detector_.reset();
+    onsets_.clear();
+    key_.clear();
+    scale_.clear();
+}
+
+void StreamingPipeline::store(OutputStats* output, const std::vector<Real>& value) {
+    output->stats.push(value.data(), value.size());
+}
+
+void StreamingPipeline::store(OutputStats* output, Real value) {
+    output->stats.push(&value, 1);
+}
+
+// Computes a node, timing it
+void StreamingPipeline::run(const Node& node) {
+    ScopedTimer timer(node.timer);
+    node.algorithm->compute();
+}
+
+void StreamingPipeline::compute_frame(Stage& stage) {
+    Nodes& nodes = stage.nodes;
+    if (nodes.windowing.planned) {
+        run(nodes.windowing);
+    }
+
+    if (nodes.fft.planned) {
+        compute_fft(stage);
+    }
+
+    if (nodes.spectral_peaks.planned) {
+        run(nodes.spectral_peaks);
+    }
+
+    if (nodes.spectrum.planned) {
+        store(nodes.spectrum.outputs[0], stage.spectrum);
+    }
+
+    if (stage.frame_kernel) {
+        compute_frame_kernel(stage);
+    }
+
+    if (stage.spectrum_kernel) {
+        compute_spectrum_kernel(stage);
+    }
+
+    if (nodes.pitch.planned) {
+        run(nodes.pitch);
+        store(nodes.pitch.outputs[0], real_);
+        store(nodes.pitch.outputs[1], real2_);
+    }
+
+    if (nodes.mfcc.planned) {
+        run(nodes.mfcc);
+        store(nodes.mfcc.outputs[0], value_);
+    }
+
+    if (nodes.dissonance.planned) {
+        run(nodes.dissonance);
+        store(nodes.dissonance.outputs[0], real_);
+    }
+
+    if (nodes.key.planned) {
+        run(nodes.hpcp);
+        run(nodes.key);
+        store(nodes.key.outputs[0], real_);
+    }
+
+    if (nodes.tristimulus.planned) {
+        run(nodes.tristimulus);
+        store(nodes.tristimulus.outputs[0], value_);
+    }
+
+    if (nodes.spectral_contrast.planned) {
+        run(nodes.spectral_contrast);
+        store(nodes.spectral_contrast.outputs[0], value_);
+        store(nodes.spectral_contrast.outputs[1], value2_);
+    }
+
+    if (nodes.spectral_complexity.planned) {
+        run(nodes.spectral_complexity);
+        store(nodes.spectral_complexity.outputs[0], real_);
+    }
+
+    if (nodes.chroma.planned) {
+        run(nodes.chroma);
+        store(nodes.chroma.outputs[0], value_);
+    }
+
+    if (nodes.onset.planned) {
+        detect_onsets(stage);
+    }
+}
+
+// The magnitude spectrum of the windowed frame, windowed while it is packed for the transform
+void StreamingPipeline::compute_fft(Stage& stage) {
+    ScopedTimer timer(stage.nodes.fft.timer);
+    if (stage.fft) {
+        stage.fft->magnitudes(stage.frame.data(), stage.window->window.data(),
+                              stage.fft_workspace.data(), stage.spectrum.data());
+        return;
+    }
+
+    const std::vector<Real>& window = stage.window->window;
+    for (size_t i = 0; i < stage.frame.size(); i++) {
+        stage.fft_frame[i] = stage.frame[i] * window[i];
+    }
+    stage.nodes.fft.algorithm->compute();
+}
+
+// rms, energy and loudness from a single pass over the frame. rms and energy are those of the
+// windowed frame the network analyses, loudness (InstantPower) that of the raw frame.
+void StreamingPipeline::compute_frame_kernel(Stage& stage) {
+    size_t n = stage.frame.size();
+    FrameEnergy energy;
+    {
+        ScopedTimer timer(stage.frame_kernel_timer);
+        energy = frame_energy(stage.frame.data(), stage.window->squares.data(), n);
+    }
+
+    Nodes& nodes = stage.nodes;
+    if (nodes.rms.planned) {
+        store(nodes.rms.outputs[0], rms(energy.windowed, n));
+    }
+    if (nodes.energy.planned) {
+        store(nodes.energy.outputs[0], Real(energy.windowed));
+    }
+    if (nodes.loudness.planned) {
+        store(nodes.loudness.outputs[0], instant_power(energy.raw, n));
+    }
+}
+
+// centroid and noisiness (Flatness) from a single pass over the spectrum, noisiness needs a
+// second one for its geometric mean unless a bin is 0
+void StreamingPipeline::compute_spectrum_kernel(Stage& stage) {
+    size_t n = stage.spectrum.size();
+    Real centroid_value, flatness_value;
+    {
+        ScopedTimer timer(stage.spectrum_kernel_timer);
+        SpectrumMoments moments = spectrum_moments(stage.spectrum.data(), n);
+        centroid_value = centroid(moments, n);
+        flatness_value =
+            stage.nodes.noisiness.planned ? flatness(moments, stage.spectrum.data(), n) : 0;
+    }
+
+    if (stage.nodes.centroid.planned) {
+        store(stage.nodes.centroid.outputs[0], centroid_value);
+    }
+    if (stage.nodes.noisiness.planned) {
+        store(stage.nodes.noisiness.outputs[0], flatness_value);
+    }
+}
+
+// The novelty of each hop only depends on the bands of the previous hop, so each hop computes one
+// band frame and hands a single novelty value to the onset detector
+void StreamingPipeline::detect_onsets(Stage& stage) {
+    std::swap(stage.bands[0], stage.bands[1]);
+    run(stage.nodes.triangle_bands);
+
+    Real novelty = 0;
+    if (!stage.bands[0].empty()) {
+        run(stage.nodes.super_flux_novelty);
+        novelty = real_;
+    }
+
+    onsets_.clear();
+    ScopedTimer timer(stage.nodes.onset.timer);
+    if (onset_detector_.process(novelty)) {
+        onsets_.push_back(onset_offset(stage.frame));
+    }
+}
+
+// Samples from the onset to the end of the frame, at least 1. The novelty rises with the newest
+// hop of the frame, so the onset is placed at the first of its samples that reaches half of its
+// peak amplitude.
+Real StreamingPipeline::onset_offset(const std::vector<Real>& frame) const {
+    size_t hop = std::min<size_t>(hop_size_, frame.size());
+    auto newest = frame.end() - hop;
+
+    Real peak = 0;
+    for (auto iter = newest; iter != frame.end(); ++iter) {
+        peak = std::max(peak, std::fabs(*iter));
+    }
+
+    for (auto iter = newest; iter != frame.end(); ++iter) {
+        if (std::fabs(*iter) >= peak / 2) {
+            return frame.end() - iter;
+        }
+    }
+    return hop;
+}
+
+// Writes the running stats of every output into the frame, O(values) per hop whatever the horizon
+void StreamingPipeline::aggregate(FeatureFrame& frame) {
+    ScopedTimer timer(aggregate_timer_);
+    frame.clear();
+
+    for (auto const& iter : outputs_) {
+        iter.second.write(frame);
+    }
+
+    // the key of the last long frame, until the next one is analysed
+    if (key_label_ >= 0) {
+        frame.label(key_label_) = key_;
+        frame.label(scale_label_) = scale_;
+    }
+
+    // NaN tells a hop without onsets from one with an onset at offset 0
+    if (onset_slot_ != NULL) {
+        frame.values(*onset_slot_)[0] = onsets_.empty() ? NAN : onsets_[0];
+        frame.events(onset_events_).assign(onsets_.begin(), onsets_.end());
+    }
+}
+
+// Repeats the previous hop's values of a stage that is not analysed this hop
+void StreamingPipeline::hold(const Stage& stage) {
+    for (auto output : stage.outputs) {
+        output->stats.repeat();
+    }
+}
+
+void StreamingPipeline::process(const std::vector<Real>& history, FeatureFrame& frame) {
+    for (auto& iter : stages_) {
+        Stage& stage = iter.second;
+        if (hop_count_ % stage.interval != 0) {
+            hold(stage);
+            continue;
+        }
+
+        // the newest frame_size samples, zero padded if the history is shorter
+        size_t n = std::min<size_t>(history.size(), stage.frame_size);
+        std::fill(stage.frame.begin(), stage.frame.end() - n, 0);
+        std::copy(history.end() - n, history.end(), stage.frame.end() - n);
+        compute_frame(stage);
+    }
+
+    hop_count_++;
+
+    aggregate(frame);
+}
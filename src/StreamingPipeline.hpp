@@ -0,0 +1,134 @@
+#ifndef _STREAMING_PIPELINE
+#define _STREAMING_PIPELINE
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <essentia/algorithmfactory.h>
+
+#include "FeatureFrame.hpp"
+#include "FeatureGraph.hpp"
+#include "FeatureSchema.hpp"
+#include "FftCache.hpp"
+#include "FrameStats.hpp"
+#include "Metrics.hpp"
+#include "OnsetDetector.hpp"
+#include "Pipeline.hpp"
+
+using namespace essentia;
+
+// Incremental analysis that keeps its state across hops. Each hop only the newest frame of each
+// resolution is windowed, transformed and described; the per-hop results feed running stats over
+// the last `horizon` hops, which are reported with the same names the network analysis uses.
+// Long frames are only analysed every few hops, their last results are held in between.
+class StreamingPipeline : public Pipeline {
+public:
+    explicit StreamingPipeline(const PipelineConfig& config);
+    ~StreamingPipeline();
+
+    // Analyses the newest frame of each resolution, cut from the end of the audio history (the
+    // plan's history_size samples), and writes the stats of the last `horizon` hops into frame
+    void process(const std::vector<Real>& history, FeatureFrame& frame) override;
+
+    // Forgets all history
+    void reset() override;
+
+private:
+    // A planned node, resolved once so that hops neither look names up nor allocate
+    struct Node {
+        bool planned = false;
+        // NULL for the nodes the fused kernels, the FFT plan or the onset detector compute
+        standard::Algorithm* algorithm = NULL;
+        Histogram* timer = NULL;
+        // the running stats of the node's aggregated outputs, in the order the node declares them
+        std::vector<OutputStats*> outputs;
+    };
+
+    // Every node a stage may run, planned or not
+    struct Nodes {
+        Node windowing, fft, spectral_peaks, triangle_bands, hpcp, super_flux_novelty, spectrum;
+        Node rms, energy, centroid, loudness, noisiness, pitch, mfcc, dissonance, key;
+        Node tristimulus, spectral_contrast, spectral_complexity, chroma, onset;
+
+        // The node of the given name, NULL for nodes streaming analysis does not run
+        Node* find(const std::string& name);
+    };
+
+    // The nodes planned at one resolution and the buffers shared between them
+    struct Stage {
+        unsigned int frame_size;
+        unsigned int interval;
+        Nodes nodes;
+        // every algorithm the stage created, owned by the stage
+        std::vector<standard::Algorithm*> algorithms;
+        // the aggregated outputs the stage stores
+        std::vector<OutputStats*> outputs;
+        // whether the stage runs the fused kernels, and their latency
+        bool frame_kernel = false;
+        bool spectrum_kernel = false;
+        Histogram* frame_kernel_timer = NULL;
+        Histogram* spectrum_kernel_timer = NULL;
+        // the FFT plan and window every pipeline with this frame size shares, for the fft and
+        // frame kernels. Sizes RealFft does not support have no plan, their fft node runs
+        // essentia's Spectrum.
+        std::shared_ptr<const RealFft> fft;
+        std::shared_ptr<const WindowTable> window;
+
+        /// intermediate buffers, reused every hop
+        std::vector<Real> frame;
+        std::vector<Real> windowed;
+        std::vector<Real> spectrum;
+        std::vector<Real> frequencies;
+        std::vector<Real> magnitudes;
+        std::vector<Real> hpcp;
+        std::vector<std::vector<Real>> bands;
+        std::vector<FftComplex> fft_workspace;
+        // the windowed frame essentia's Spectrum transforms when there is no FFT plan
+        std::vector<Real> fft_frame;
+    };
+
+    void bind(Stage& stage);
+    void compute_frame(Stage& stage);
+    void compute_fft(Stage& stage);
+    void compute_frame_kernel(Stage& stage);
+    void compute_spectrum_kernel(Stage& stage);
+    void run(const Node& node);
+    void store(OutputStats* output, const std::vector<Real>& value);
+    void store(OutputStats* output, Real value);
+    void hold(const Stage& stage);
+    void detect_onsets(Stage& stage);
+    Real onset_offset(const std::vector<Real>& frame) const;
+    void aggregate(FeatureFrame& frame);
+
+    unsigned int sample_rate_;
+    unsigned int hop_size_;
+    FeaturePlan plan_;
+    FeatureSchema schema_;
+    const FeatureSlot* onset_slot_;
+    int onset_events_;
+    int key_label_;
+    int scale_label_;
+
+    // stages are never added after construction, so the buffers bound to algorithms stay put
+    std::map<Resolution, Stage> stages_;
+
+    // by output name
+    std::map<std::string, OutputStats> outputs_;
+    size_t hop_count_;
+    Histogram* aggregate_timer_;
+
+    // the per-hop results of the algorithms, bound once
+    std::vector<Real> value_;
+    std::vector<Real> value2_;
+    Real real_;
+    Real real2_;
+    std::string key_;
+    std::string scale_;
+    OnsetDetector onset_detector_;
+    // offsets of the onsets detected in the newest hop
+    std::vector<Real> onsets_;
+};
+
+#endif
@@ -0,0 +1,73 @@
+#include <cstdio>
+
+#include "BinaryProtocol.hpp"
+#include "TimelineWriter.hpp"
+
+bool BinaryTimelineWriter::open(const std::string& path, const FeatureSchema& schema,
+                                const PipelineConfig& config) {
+    std::ofstream schema_out(path + ".schema.json");
+    schema_out << schema.to_json();
+    if (!schema_out) {
+        return false;
+    }
+
+    value_count_ = schema.size();
+    record_.resize(FEATURES_HEADER_SIZE + value_count_ * sizeof(float));
+    out_.open(path, std::ios::binary);
+    return static_cast<bool>(out_);
+}
+
+void BinaryTimelineWriter::write(size_t hop, const essentia::Real* values) {
+    // offline hops have no frames or receive times, every hop describes its own hop of audio
+    FeaturesHeader header = {0, uint32_t(hop), uint32_t(value_count_), uint32_t(hop), 0, 0, 0};
+    encode_features_header(header, record_.data());
+    encode_values(values, value_count_, record_.data() + FEATURES_HEADER_SIZE);
+    out_.write(record_.data(), record_.size());
+}
+
+bool BinaryTimelineWriter::close() {
+    out_.close();
+    return static_cast<bool>(out_);
+}
+
+bool CsvTimelineWriter::open(const std::string& path, const FeatureSchema& schema,
+                             const PipelineConfig& config) {
+    out_.open(path);
+    value_count_ = schema.size();
+    seconds_per_hop_ = static_cast<double>(config.hop_size) / config.sample_rate;
+
+    // vectors get a column per value, e.g. mfcc.mean[0]
+    out_ << "time";
+    for (auto const& slot : schema.slots()) {
+        if (slot.length == 1) {
+            out_ << ',' << slot.name;
+            continue;
+        }
+        for (size_t i = 0; i < slot.length; i++) {
+            out_ << ',' << slot.name << '[' << i << ']';
+        }
+    }
+    out_ << '\n';
+
+    return static_cast<bool>(out_);
+}
+
+void CsvTimelineWriter::write(size_t hop, const essentia::Real* values) {
+    char number[32];
+
+    row_.clear();
+    std::snprintf(number, sizeof(number), "%.6f", (hop + 1) * seconds_per_hop_);
+    row_ += number;
+    for (size_t i = 0; i < value_count_; i++) {
+        std::snprintf(number, sizeof(number), ",%.9g", values[i]);
+        row_ += number;
+    }
+    row_ += '\n';
+
+    out_.write(row_.data(), row_.size());
+}
+
+bool CsvTimelineWriter::close() {
+    out_.close();
+    return static_cast<bool>(out_);
+}
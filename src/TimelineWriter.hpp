@@ -0,0 +1,58 @@
+#ifndef _TIMELINE_WRITER
+#define _TIMELINE_WRITER
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <essentia/types.h>
+
+#include "FeatureSchema.hpp"
+
+// Writes the features of every hop of an offline analysis, in hop order
+class TimelineWriter {
+public:
+    virtual ~TimelineWriter() {}
+
+    // Opens the output, returns false if it cannot be written
+    virtual bool open(const std::string& path, const FeatureSchema& schema,
+                      const PipelineConfig& config) = 0;
+
+    // Writes the schema().size() values of a hop
+    virtual void write(size_t hop, const essentia::Real* values) = 0;
+
+    virtual bool close() = 0;
+};
+
+// One record per hop laid out exactly like a binary audio_features message, with session_id 0
+// and the hop as the sequence. The schema is written next to it, to <path>.schema.json.
+class BinaryTimelineWriter : public TimelineWriter {
+public:
+    bool open(const std::string& path, const FeatureSchema& schema,
+              const PipelineConfig& config) override;
+    void write(size_t hop, const essentia::Real* values) override;
+    bool close() override;
+
+private:
+    std::ofstream out_;
+    std::vector<char> record_;
+    size_t value_count_;
+};
+
+// A header row naming every value, then one row per hop starting with the time of its last
+// sample in seconds
+class CsvTimelineWriter : public TimelineWriter {
+public:
+    bool open(const std::string& path, const FeatureSchema& schema,
+              const PipelineConfig& config) override;
+    void write(size_t hop, const essentia::Real* values) override;
+    bool close() override;
+
+private:
+    std::ofstream out_;
+    std::string row_;
+    size_t value_count_;
+    double seconds_per_hop_;
+};
+
+#endif
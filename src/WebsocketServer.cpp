@@ -3,6 +3,7 @@
 #include <algorithm>
 #include <functional>
 #include <iostream>
+#include <thread>
 
 #include "WebsocketServer.hpp"
 
@@ -17,15 +18,19 @@ Json::Value WebsocketServer::parse_json(const string& json) {
 }
 
 string WebsocketServer::stringify_json(const Json::Value& val) {
-    // When we transmit JSON data, we omit all whitespace
-    Json::StreamWriterBuilder wbuilder;
-    wbuilder["commentStyle"] = "None";
-    wbuilder["indentation"] = "";
+    // When we transmit JSON data, we omit all whitespace. The settings are built once, writing
+    // with them is thread safe.
+    static const Json::StreamWriterBuilder wbuilder = []() {
+        Json::StreamWriterBuilder builder;
+        builder["commentStyle"] = "None";
+        builder["indentation"] = "";
+        return builder;
+    }();
 
     return Json::writeString(wbuilder, val);
 }
 
-WebsocketServer::WebsocketServer() {
+WebsocketServer::WebsocketServer() : handlers_(std::make_shared<WebsocketHandlers>()) {
     this->endpoint_.clear_access_channels(websocketpp::log::alevel::control);
     this->endpoint_.clear_access_channels(websocketpp::log::alevel::frame_header);
     this->endpoint_.clear_access_channels(websocketpp::log::alevel::frame_payload);
@@ -37,18 +42,50 @@ WebsocketServer::WebsocketServer() {
         std::bind(&WebsocketServer::on_close, this, std::placeholders::_1));
     this->endpoint_.set_message_handler(std::bind(&WebsocketServer::on_message, this,
                                                   std::placeholders::_1, std::placeholders::_2));
+    this->endpoint_.set_http_handler(
+        std::bind(&WebsocketServer::on_http, this, std::placeholders::_1));
 
     // Initialise the Asio library, using our own event loop object
     this->endpoint_.init_asio(&(this->event_loop_));
 }
 
-void WebsocketServer::run(int port) {
+void WebsocketServer::run(int port, unsigned int threads) {
     // Listen on the specified port number and start accepting connections
     this->endpoint_.listen(port);
     this->endpoint_.start_accept();
 
-    // Start the Asio event loop
+    // Run the Asio event loop on a pool of threads, the calling thread being one of them
+    vector<std::thread> pool;
+    for (unsigned int i = 1; i < threads; i++) {
+        pool.emplace_back([this]() { this->endpoint_.run(); });
+    }
     this->endpoint_.run();
+
+    for (auto& thread : pool) {
+        thread.join();
+    }
+}
+
+void WebsocketServer::update_handlers(const std::function<void(WebsocketHandlers&)>& update) {
+    // Registrations are serialised, readers keep using the snapshot they loaded
+    std::lock_guard<std::mutex> lock(this->handler_mutex_);
+
+    auto handlers = std::make_shared<WebsocketHandlers>(*this->handlers_);
+    update(*handlers);
+    std::atomic_store(&this->handlers_, std::shared_ptr<const WebsocketHandlers>(handlers));
+}
+
+std::shared_ptr<const WebsocketHandlers> WebsocketServer::handlers() {
+    return std::atomic_load(&this->handlers_);
+}
+
+WebsocketServer::Strand WebsocketServer::strand(ClientConnection conn) {
+    websocketpp::lib::error_code ec;
+    auto connection = this->endpoint_.get_con_from_hdl(conn, ec);
+    if (ec) {
+        return nullptr;
+    }
+    return connection->get_strand();
 }
 
 size_t WebsocketServer::num_connections() {
@@ -64,31 +101,81 @@ void WebsocketServer::send_message(ClientConnection conn, const string& message_
     Json::Value message_data = arguments;
     message_data[MESSAGE_FIELD] = message_type;
 
-    // Send the JSON data to the client (will happen on the networking thread's event loop)
+    // Send the JSON data to the client (will happen on the networking threads' event loop).
+    // A connection that closed in the meantime is not an error for the caller.
+    websocketpp::lib::error_code ec;
     this->endpoint_.send(conn, WebsocketServer::stringify_json(message_data),
-                         websocketpp::frame::opcode::text);
+                         websocketpp::frame::opcode::text, ec);
+}
+
+void WebsocketServer::send_binary(ClientConnection conn, const void* data, size_t size) {
+    // websocketpp copies the payload into its outgoing message before returning
+    websocketpp::lib::error_code ec;
+    this->endpoint_.send(conn, data, size, websocketpp::frame::opcode::binary, ec);
+}
+
+// RFC 6455 frames sent by a server are neither masked nor, without extensions, compressed, so a
+// header is all the payload needs. Clients of the hybi-00 draft, which send no version header,
+// get websocketpp's framing, which copies the payload.
+void WebsocketServer::send_framed(WebsocketEndpoint::connection_ptr connection,
+                                  WebsocketEndpoint::message_ptr message) {
+    static const string version_header = "Sec-WebSocket-Version";
+    if (!connection->get_request_header(version_header).empty()) {
+        size_t size = message->get_payload().size();
+        websocketpp::frame::basic_header header(message->get_opcode(), size, true, false);
+        websocketpp::frame::extended_header extended(size);
+        message->set_header(websocketpp::frame::prepare_header(header, extended));
+        message->set_prepared(true);
+    }
+
+    // a connection that closed in the meantime is not an error for the caller
+    connection->send(message);
 }
 
 void WebsocketServer::broadcast_message(const string& message_type, const Json::Value& arguments) {
-    // Prevent concurrent access to the list of open connections from multiple threads
-    std::lock_guard<std::mutex> lock(this->connection_list_mutex_);
+    vector<ClientConnection> connections;
+    {
+        // Prevent concurrent access to the list of open connections from multiple threads, but
+        // send outside the lock so that closing connections never wait for a broadcast
+        std::lock_guard<std::mutex> lock(this->connection_list_mutex_);
+        connections.assign(this->open_connections_.begin(), this->open_connections_.end());
+    }
 
-    for (auto conn : this->open_connections_) {
+    for (auto conn : connections) {
         this->send_message(conn, message_type, arguments);
     }
 }
 
+size_t WebsocketServer::buffered_amount(ClientConnection conn) {
+    websocketpp::lib::error_code ec;
+    auto connection = this->endpoint_.get_con_from_hdl(conn, ec);
+    if (ec) {
+        return 0;
+    }
+    return connection->get_buffered_amount();
+}
+
+void WebsocketServer::close(ClientConnection conn, const string& reason) {
+    // Any messages already queued for the client are sent before the close frame
+    websocketpp::lib::error_code ec;
+    this->endpoint_.close(conn, websocketpp::close::status::normal, reason, ec);
+    if (ec) {
+        std::clog << "Error closing connection: " << ec.message() << std::endl;
+    }
+}
+
 void WebsocketServer::on_open(ClientConnection conn) {
     {
         // Prevent concurrent access to the list of open connections from multiple threads
         std::lock_guard<std::mutex> lock(this->connection_list_mutex_);
 
         // Add the connection handle to our list of open connections
-        this->open_connections_.push_back(conn);
+        this->open_connections_.insert(conn);
     }
 
     // Invoke any registered handlers
-    for (auto handler : this->connect_handlers_) {
+    auto handlers = this->handlers();
+    for (auto& handler : handlers->connect) {
         handler(conn);
     }
 }
@@ -99,36 +186,47 @@ void WebsocketServer::on_close(ClientConnection conn) {
         std::lock_guard<std::mutex> lock(this->connection_list_mutex_);
 
         // Remove the connection handle from our list of open connections
-        auto conn_val = conn.lock();
-        auto new_end =
-            std::remove_if(this->open_connections_.begin(), this->open_connections_.end(),
-                           [&conn_val](ClientConnection elem) {
-                               // If the pointer has expired, remove it from the vector
-                               if (elem.expired() == true) {
-                                   return true;
-                               }
-
-                               // If the pointer is still valid, compare it to the handle
-                               // for the closed connection
-                               auto elem_val = elem.lock();
-                               if (elem_val.get() == conn_val.get()) {
-                                   return true;
-                               }
-
-                               return false;
-                           });
-
-        // Truncate the connections vector to erase the removed elements
-        this->open_connections_.resize(std::distance(this->open_connections_.begin(), new_end));
+        this->open_connections_.erase(conn);
     }
 
     // Invoke any registered handlers
-    for (auto handler : this->disconnect_handlers_) {
+    auto handlers = this->handlers();
+    for (auto& handler : handlers->disconnect) {
         handler(conn);
     }
 }
 
+void WebsocketServer::on_http(ClientConnection conn) {
+    auto connection = this->endpoint_.get_con_from_hdl(conn);
+
+    // The query string is ignored
+    string path = connection->get_resource();
+    path = path.substr(0, path.find('?'));
+
+    auto handlers = this->handlers();
+    auto handler = handlers->http.find(path);
+    if (handler == handlers->http.end()) {
+        connection->set_status(websocketpp::http::status_code::not_found);
+        return;
+    }
+
+    string content_type = "text/plain";
+    connection->set_body(handler->second(content_type));
+    connection->replace_header("Content-Type", content_type);
+    connection->set_status(websocketpp::http::status_code::ok);
+}
+
 void WebsocketServer::on_message(ClientConnection conn, WebsocketEndpoint::message_ptr msg) {
+    auto handlers = this->handlers();
+
+    // Binary messages are handed over as-is, without a copy of the payload
+    if (msg->get_opcode() == websocketpp::frame::opcode::binary) {
+        for (auto& handler : handlers->binary) {
+            handler(conn, msg->get_payload());
+        }
+        return;
+    }
+
     // Validate that the incoming message contains valid JSON
     Json::Value message_object = WebsocketServer::parse_json(msg->get_payload());
     if (message_object.isNull() == false) {
@@ -139,9 +237,11 @@ void WebsocketServer::on_message(ClientConnection conn, WebsocketEndpoint::messa
             message_object.removeMember(MESSAGE_FIELD);
 
             // If any handlers are registered for the message type, invoke them
-            auto& handlers = this->message_handlers_[message_type];
-            for (auto handler : handlers) {
-                handler(conn, message_object);
+            auto registered = handlers->message.find(message_type);
+            if (registered != handlers->message.end()) {
+                for (auto& handler : registered->second) {
+                    handler(conn, message_object);
+                }
             }
         }
     } else {
@@ -11,9 +11,12 @@
 #include <websocketpp/config/asio_no_tls.hpp>
 #include <websocketpp/server.hpp>
 
+#include <atomic>
 #include <functional>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -21,64 +24,218 @@ using std::map;
 using std::string;
 using std::vector;
 
-typedef websocketpp::server<websocketpp::config::asio> WebsocketEndpoint;
+// messages each connection keeps for reuse, and the payload capacity a kept message may retain
+#define POOLED_MESSAGES 16
+#define POOLED_PAYLOAD_CAPACITY (1 << 20)
+
+// websocketpp message manager that keeps a connection's messages for reuse: a message is handed
+// out again once websocketpp holds no reference to it, with its payload's capacity, so sending
+// and receiving allocate no messages once the connection has warmed up. Used from the
+// connection's strand and from threads that send to it, hence the lock.
+template <typename message>
+class MessagePool : public std::enable_shared_from_this<MessagePool<message>> {
+public:
+    typedef MessagePool<message> type;
+    typedef std::shared_ptr<MessagePool> ptr;
+    typedef std::weak_ptr<MessagePool> weak_ptr;
+    typedef typename message::ptr message_ptr;
+
+    MessagePool() { messages_.reserve(POOLED_MESSAGES); }
+
+    message_ptr get_message() {
+        std::lock_guard<std::mutex> guard(mutex_);
+        message_ptr msg = reuse();
+        return msg ? msg : keep(std::make_shared<message>(this->shared_from_this()));
+    }
+
+    message_ptr get_message(websocketpp::frame::opcode::value op, size_t size) {
+        std::lock_guard<std::mutex> guard(mutex_);
+        message_ptr msg = reuse();
+        if (!msg) {
+            return keep(std::make_shared<message>(this->shared_from_this(), op, size));
+        }
+        msg->set_opcode(op);
+        msg->get_raw_payload().reserve(size);
+        return msg;
+    }
+
+    // Messages are reused by reference count, never handed back
+    bool recycle(message*) { return false; }
+
+private:
+    // An emptied message only the pool references, null if there is none
+    message_ptr reuse() {
+        for (auto const& msg : messages_) {
+            if (msg.use_count() != 1) {
+                continue;
+            }
+            // orders the last user's writes to the message before ours
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            std::string& payload = msg->get_raw_payload();
+            if (payload.capacity() > POOLED_PAYLOAD_CAPACITY) {
+                std::string().swap(payload);
+            }
+            payload.clear();
+            msg->set_header("");
+            msg->set_prepared(false);
+            msg->set_fin(true);
+            msg->set_terminal(false);
+            msg->set_compressed(false);
+            return msg;
+        }
+        return message_ptr();
+    }
+
+    message_ptr keep(message_ptr msg) {
+        if (messages_.size() < POOLED_MESSAGES) {
+            messages_.push_back(msg);
+        }
+        return msg;
+    }
+
+    std::vector<message_ptr> messages_;
+    std::mutex mutex_;
+};
+
+// The asio config of websocketpp, with pooled messages
+struct WebsocketConfig : public websocketpp::config::asio {
+    typedef WebsocketConfig type;
+    typedef websocketpp::config::asio base;
+
+    typedef websocketpp::message_buffer::message<MessagePool> message_type;
+    typedef MessagePool<message_type> con_msg_manager_type;
+    typedef websocketpp::message_buffer::alloc::endpoint_msg_manager<con_msg_manager_type>
+        endpoint_msg_manager_type;
+};
+
+typedef websocketpp::server<WebsocketConfig> WebsocketEndpoint;
 typedef websocketpp::connection_hdl ClientConnection;
 
+// The handlers registered with a server. A snapshot is shared by the networking threads and
+// replaced as a whole when a handler is registered, so dispatching a message takes no lock.
+struct WebsocketHandlers {
+    vector<std::function<void(ClientConnection)>> connect;
+    vector<std::function<void(ClientConnection)>> disconnect;
+    map<string, vector<std::function<void(ClientConnection, const Json::Value&)>>> message;
+    vector<std::function<void(ClientConnection, const string&)>> binary;
+    map<string, std::function<string(string& content_type)>> http;
+};
+
+// The endpoint runs on a pool of networking threads. websocketpp gives every connection its own
+// strand, so the handlers of one connection are never invoked concurrently and see its messages
+// in order, while different connections are handled in parallel.
 class WebsocketServer {
 public:
+    typedef std::shared_ptr<asio::io_service::strand> Strand;
+
     WebsocketServer();
-    void run(int port);
+
+    // Serves the port on `threads` networking threads, including the calling one, until stopped
+    void run(int port, unsigned int threads = 1);
 
     // Returns the number of currently connected clients
     size_t num_connections();
 
     // Registers a callback for when a client connects
     template <typename CallbackTy> void connect(CallbackTy handler) {
-        // Make sure we only access the handlers list from the networking thread
-        this->event_loop_.post([this, handler]() { this->connect_handlers_.push_back(handler); });
+        this->update_handlers([&handler](WebsocketHandlers& h) { h.connect.push_back(handler); });
     }
 
     // Registers a callback for when a client disconnects
     template <typename CallbackTy> void disconnect(CallbackTy handler) {
-        // Make sure we only access the handlers list from the networking thread
-        this->event_loop_.post(
-            [this, handler]() { this->disconnect_handlers_.push_back(handler); });
+        this->update_handlers(
+            [&handler](WebsocketHandlers& h) { h.disconnect.push_back(handler); });
     }
 
     // Registers a callback for when a particular type of message is received
+    //(Note: the callback is invoked on the connection's strand)
     template <typename CallbackTy> void message(const string& message_type, CallbackTy handler) {
-        // Make sure we only access the handlers list from the networking thread
-        this->event_loop_.post([this, message_type, handler]() {
-            this->message_handlers_[message_type].push_back(handler);
+        this->update_handlers([&message_type, &handler](WebsocketHandlers& h) {
+            h.message[message_type].push_back(handler);
         });
     }
 
+    // Registers a callback for binary messages, which bypass JSON parsing entirely
+    //(Note: the callback is invoked on the connection's strand with the raw message payload)
+    template <typename CallbackTy> void binary_message(CallbackTy handler) {
+        this->update_handlers([&handler](WebsocketHandlers& h) { h.binary.push_back(handler); });
+    }
+
+    // Registers a callback that answers plain HTTP GET requests for a path on the same port,
+    // returning the response body and setting its content type
+    //(Note: the callback may be invoked on any networking thread)
+    template <typename CallbackTy> void http(const string& path, CallbackTy handler) {
+        this->update_handlers([&path, &handler](WebsocketHandlers& h) { h.http[path] = handler; });
+    }
+
+    // The strand that serialises the connection's handlers and writes, nullptr if it is gone.
+    // Work posted to it runs on the networking threads in order with the connection's messages.
+    Strand strand(ClientConnection conn);
+
+    asio::io_service& event_loop() { return this->event_loop_; }
+
     // Sends a message to an individual client
-    //(Note: the data transmission will take place on the thread that called WebsocketServer::run())
+    //(Note: the data transmission will take place on one of the networking threads)
     void send_message(ClientConnection conn, const string& message_type,
                       const Json::Value& arguments);
 
+    // Sends a binary message to an individual client
+    //(Note: the data transmission will take place on one of the networking threads)
+    void send_binary(ClientConnection conn, const void* data, size_t size);
+
+    // Sends a message whose payload write(std::string& payload) appends to an empty buffer. The
+    // buffer is one of the connection's pooled websocketpp messages and is framed where it was
+    // written, so the payload is neither returned by value nor copied on its way to the socket.
+    //(Note: the data transmission will take place on one of the networking threads)
+    template <typename Writer> void send_written(ClientConnection conn, bool binary, Writer write) {
+        websocketpp::lib::error_code ec;
+        auto connection = this->endpoint_.get_con_from_hdl(conn, ec);
+        if (ec) {
+            return;
+        }
+
+        auto message = connection->get_message(
+            binary ? websocketpp::frame::opcode::binary : websocketpp::frame::opcode::text, 0);
+        write(message->get_raw_payload());
+        this->send_framed(connection, message);
+    }
+
     // Sends a message to all connected clients
-    //(Note: the data transmission will take place on the thread that called WebsocketServer::run())
+    //(Note: the data transmission will take place on the networking threads)
     void broadcast_message(const string& message_type, const Json::Value& arguments);
 
+    // Returns the number of bytes queued for a client that have not been written to its socket yet,
+    // 0 if the connection is gone
+    size_t buffered_amount(ClientConnection conn);
+
+    // Closes the connection to an individual client
+    void close(ClientConnection conn, const string& reason);
+
 protected:
     static Json::Value parse_json(const string& json);
     static string stringify_json(const Json::Value& val);
 
+    void send_framed(WebsocketEndpoint::connection_ptr connection,
+                     WebsocketEndpoint::message_ptr message);
+
     void on_open(ClientConnection conn);
     void on_close(ClientConnection conn);
     void on_message(ClientConnection conn, WebsocketEndpoint::message_ptr msg);
+    void on_http(ClientConnection conn);
+
+    // Applies a change to a copy of the handlers and publishes the copy, safe from any thread
+    void update_handlers(const std::function<void(WebsocketHandlers&)>& update);
+    std::shared_ptr<const WebsocketHandlers> handlers();
 
     asio::io_service event_loop_;
     WebsocketEndpoint endpoint_;
-    vector<ClientConnection> open_connections_;
+    std::set<ClientConnection, std::owner_less<ClientConnection>> open_connections_;
     std::mutex connection_list_mutex_;
 
-    vector<std::function<void(ClientConnection)>> connect_handlers_;
-    vector<std::function<void(ClientConnection)>> disconnect_handlers_;
-    map<string, vector<std::function<void(ClientConnection, const Json::Value&)>>>
-        message_handlers_;
+    // only replaced under handler_mutex_, read with std::atomic_load
+    std::shared_ptr<const WebsocketHandlers> handlers_;
+    std::mutex handler_mutex_;
 };
 
 #endif
@@ -0,0 +1,328 @@
+// Measures what a hop costs for a given sample rate, hop size, memory, mode and feature list by
+// driving the pipelines directly, without the network or the analyzer threads. Every run is
+// printed to stdout as one JSON object per line, so results of two builds can be compared with
+// any JSON tool. With --max-allocations it also fails when a run allocates more per hop, which
+// the tests use to check that steady-state hops and their messages allocate nothing.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <essentia/algorithmfactory.h>
+#include <json/json.h>
+
+#include "Allocations.hpp"
+#include "AudioFile.hpp"
+#include "FeatureEncoder.hpp"
+#include "FeatureFrame.hpp"
+#include "FeatureGraph.hpp"
+#include "FeatureSchema.hpp"
+#include "JsonWriter.hpp"
+#include "Pipeline.hpp"
+#include "PipelineCache.hpp"
+
+using essentia::Real;
+
+struct BenchOptions {
+    std::vector<unsigned int> sample_rates = {22050, 44100, 48000};
+    std::vector<unsigned int> hop_sizes = {256, 512, 1024};
+    std::vector<unsigned int> memories = {4, 16};
+    std::vector<std::string> modes = {"window", "streaming"};
+    // each feature on its own, then all of them together
+    std::vector<std::vector<std::string>> feature_sets;
+    unsigned int hops = 200;
+    unsigned int warmup_hops = 20;
+    std::string input;
+    // allocations per hop a run may make in its pipeline or its messages, -1 for any number
+    long max_allocations = -1;
+};
+
+// Audio a pipeline is fed in a loop
+struct BenchSource {
+    std::string name;
+    unsigned int sample_rate;
+    std::vector<Real> samples;
+};
+
+// A few seconds of a harmonic sweep over noise, with a click every half second so that onsets
+// and transient features have something to detect
+static BenchSource synthetic_source(unsigned int sample_rate) {
+    BenchSource source;
+    source.name = "synthetic";
+    source.sample_rate = sample_rate;
+    source.samples.resize(sample_rate * 4);
+
+    std::minstd_rand random(42);
+    std::uniform_real_distribution<Real> noise(-0.03, 0.03);
+    double phase = 0;
+    for (size_t i = 0; i < source.samples.size(); i++) {
+        double t = static_cast<double>(i) / sample_rate;
+        double frequency = 110 * std::pow(2.0, t);
+        phase += 2 * M_PI * frequency / sample_rate;
+
+        Real sample =
+            0.4 * std::sin(phase) + 0.2 * std::sin(2 * phase) + 0.1 * std::sin(3 * phase);
+        if (i % (sample_rate / 2) < 64) {
+            sample += 0.8 * (1 - (i % (sample_rate / 2)) / 64.0);
+        }
+        source.samples[i] = sample + noise(random);
+    }
+    return source;
+}
+
+static bool recorded_source(const std::string& path, BenchSource& source) {
+    AudioFile file;
+    if (!file.open_wav(path)) {
+        std::cerr << file.error() << std::endl;
+        return false;
+    }
+
+    source.name = path;
+    source.sample_rate = file.sample_rate();
+    source.samples.resize(file.frames());
+    file.read(0, file.frames(), source.samples.data());
+    return !source.samples.empty();
+}
+
+static double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t index = std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()));
+    return sorted[index];
+}
+
+static std::string join(const std::vector<std::string>& items) {
+    std::string joined;
+    for (auto const& item : items) {
+        joined += (joined.empty() ? "" : ",") + item;
+    }
+    return joined;
+}
+
+// Feeds options.hops hops of the source to a pipeline built for the config, after a warm-up,
+// with the sliding history the Analyzer keeps
+static Json::Value run(const BenchSource& source, const PipelineConfig& config,
+                       const BenchOptions& options, PipelineCache& pipelines) {
+    FeaturePlan plan = FeatureGraph::instance().plan(config);
+    auto schema = std::make_shared<const FeatureSchema>(plan, config);
+    std::unique_ptr<Pipeline> pipeline = pipelines.acquire(config);
+
+    FeatureFrame frame(schema);
+    std::vector<Real> history(plan.history_size, 0);
+    size_t hop_size = config.hop_size;
+    size_t position = 0;
+
+    // every hop is also written in every message format, each into a buffer reused like the
+    // connection's pooled messages
+    EncodingOptions quantized;
+    quantized.bits = 8;
+    std::vector<FeatureEncoder> encoders = {
+        FeatureEncoder(0, false, FLOAT_DIGITS, EncodingOptions()),
+        FeatureEncoder(0, true, FLOAT_DIGITS, EncodingOptions()),
+        FeatureEncoder(0, true, FLOAT_DIGITS, quantized)};
+    std::vector<std::string> messages(encoders.size());
+
+    std::vector<double> latencies;
+    latencies.reserve(options.hops);
+    unsigned long hop_allocations = 0;
+    unsigned long serialize_allocations = 0;
+    double total = 0;
+
+    for (unsigned int i = 0; i < options.warmup_hops + options.hops; i++) {
+        size_t keep = history.size() > hop_size ? history.size() - hop_size : 0;
+        std::copy(history.end() - keep, history.end(), history.begin());
+        for (size_t j = keep; j < history.size(); j++) {
+            history[j] = source.samples[position];
+            position = (position + 1) % source.samples.size();
+        }
+
+        // the pipeline runs on this thread, so its allocations are the thread's
+        unsigned long long allocated = thread_allocations();
+        auto start = std::chrono::steady_clock::now();
+        pipeline->process(history, frame);
+        std::chrono::duration<double, std::micro> elapsed =
+            std::chrono::steady_clock::now() - start;
+
+        if (i >= options.warmup_hops) {
+            hop_allocations += thread_allocations() - allocated;
+            latencies.push_back(elapsed.count());
+            total += elapsed.count();
+        }
+
+        allocated = thread_allocations();
+        for (size_t j = 0; j < encoders.size(); j++) {
+            encoders[j].write(i, frame, messages[j]);
+        }
+        if (i >= options.warmup_hops) {
+            serialize_allocations += thread_allocations() - allocated;
+        }
+
+        // pooled messages keep the capacity of the longest message they held, leave room for
+        // messages longer than the warm-up's, such as hops with more onsets
+        if (i + 1 == options.warmup_hops) {
+            for (auto& message : messages) {
+                message.reserve(2 * message.capacity());
+            }
+        }
+    }
+
+    pipelines.release(config, std::move(pipeline));
+    std::sort(latencies.begin(), latencies.end());
+
+    double hops_per_second = total > 0 ? options.hops * 1e6 / total : 0;
+
+    Json::Value result;
+    result["source"] = source.name;
+    result["sample_rate"] = config.sample_rate;
+    result["hop_size"] = config.hop_size;
+    result["memory"] = config.memory;
+    result["mode"] = config.streaming ? "streaming" : "window";
+    result["features"] = join(config.features);
+    result["hops"] = options.hops;
+    result["p50_us"] = percentile(latencies, 0.50);
+    result["p99_us"] = percentile(latencies, 0.99);
+    result["max_us"] = latencies.empty() ? 0 : latencies.back();
+    result["mean_us"] = latencies.empty() ? 0 : total / latencies.size();
+    // one analyzer thread per session, so this is the throughput of one core
+    result["hops_per_second"] = hops_per_second;
+    result["realtime_factor"] = hops_per_second * config.hop_size / config.sample_rate;
+    result["allocations_per_hop"] = static_cast<double>(hop_allocations) / options.hops;
+    result["serialize_allocations_per_hop"] =
+        static_cast<double>(serialize_allocations) / options.hops;
+    return result;
+}
+
+static std::vector<unsigned int> parse_numbers(const std::string& list) {
+    std::vector<unsigned int> numbers;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (std::atoi(item.c_str()) > 0) {
+            numbers.push_back(std::atoi(item.c_str()));
+        }
+    }
+    return numbers;
+}
+
+static std::vector<std::string> parse_names(const std::string& list) {
+    std::vector<std::string> names;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            names.push_back(item);
+        }
+    }
+    return names;
+}
+
+static void usage() {
+    std::cerr << "usage: mirlin_bench [options]\n"
+                 "  --sample-rates <hz,...>   22050,44100,48000\n"
+                 "  --hop-sizes <samples,...> 256,512,1024\n"
+                 "  --memory <hops,...>       4,16\n"
+                 "  --modes <window,streaming>\n"
+                 "  --features <f1,f2,...>    run together, default: each feature alone, then all\n"
+                 "  --hops <count>            200 measured hops per run\n"
+                 "  --input <file.wav>        also run on recorded audio, at its sample rate\n"
+                 "  --max-allocations <count> fail if a run allocates more per hop, in its\n"
+                 "                            pipeline or its messages"
+              << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    std::vector<std::string> features;
+
+    for (int i = 1; i < argc; i += 2) {
+        std::string name = argv[i];
+        if (i + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        std::string value = argv[i + 1];
+
+        if (name == "--sample-rates") {
+            options.sample_rates = parse_numbers(value);
+        } else if (name == "--hop-sizes") {
+            options.hop_sizes = parse_numbers(value);
+        } else if (name == "--memory") {
+            options.memories = parse_numbers(value);
+        } else if (name == "--modes") {
+            options.modes = parse_names(value);
+        } else if (name == "--features") {
+            features = parse_names(value);
+        } else if (name == "--hops") {
+            options.hops = std::max(1, std::atoi(value.c_str()));
+        } else if (name == "--input") {
+            options.input = value;
+        } else if (name == "--max-allocations") {
+            options.max_allocations = std::atol(value.c_str());
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    if (features.empty()) {
+        for (auto const& feature : FeatureGraph::instance().features()) {
+            options.feature_sets.push_back({feature});
+        }
+        features = FeatureGraph::instance().features();
+    }
+    options.feature_sets.push_back(features);
+
+    essentia::init();
+
+    std::vector<BenchSource> sources;
+    for (auto sample_rate : options.sample_rates) {
+        sources.push_back(synthetic_source(sample_rate));
+    }
+    if (!options.input.empty()) {
+        BenchSource recorded;
+        if (!recorded_source(options.input, recorded)) {
+            return 1;
+        }
+        sources.push_back(recorded);
+    }
+
+    Json::StreamWriterBuilder writer;
+    writer["commentStyle"] = "None";
+    writer["indentation"] = "";
+
+    PipelineCache pipelines(0);
+    bool failed = false;
+    for (auto const& source : sources) {
+        for (auto hop_size : options.hop_sizes) {
+            for (auto memory : options.memories) {
+                for (auto const& mode : options.modes) {
+                    for (auto const& feature_set : options.feature_sets) {
+                        PipelineConfig config(source.sample_rate, hop_size, memory, feature_set,
+                                              mode == "streaming");
+                        Json::Value result = run(source, config, options, pipelines);
+                        std::cout << Json::writeString(writer, result) << std::endl;
+
+                        double allowed = static_cast<double>(options.max_allocations);
+                        if (options.max_allocations >= 0 &&
+                            (result["allocations_per_hop"].asDouble() > allowed ||
+                             result["serialize_allocations_per_hop"].asDouble() > allowed)) {
+                            std::cerr << "allocates in the steady state: "
+                                      << Json::writeString(writer, result) << std::endl;
+                            failed = true;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    return failed ? 1 : 0;
+}
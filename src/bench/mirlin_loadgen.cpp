@@ -0,0 +1,481 @@
+// Opens many sessions against a running server and streams synthetic audio to each of them at
+// real-time pace (or faster), measuring the round trip from sending a frame to receiving its
+// features through the whole main_event_loop -> Analyzer -> send path. The summary is printed to
+// stdout as a single JSON object.
+//
+// Replies are matched to frames by the frame_sequence the server echoes, in the binary features
+// header or the JSON payload. When the backlog policy skips frames, they show up as missing.
+
+#ifndef ASIO_STANDALONE
+#define ASIO_STANDALONE
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <asio/steady_timer.hpp>
+#include <json/json.h>
+#include <websocketpp/client.hpp>
+#include <websocketpp/config/asio_no_tls_client.hpp>
+
+#include "BinaryProtocol.hpp"
+
+typedef websocketpp::client<websocketpp::config::asio_client> LoadClient;
+typedef std::chrono::steady_clock Clock;
+
+struct LoadOptions {
+    std::string uri = "ws://localhost:9002";
+    unsigned int sessions = 8;
+    unsigned int sample_rate = 44100;
+    unsigned int hop_size = 512;
+    // interleaved channels of every frame, all carrying the same tone
+    unsigned int channels = 1;
+    unsigned int memory = 4;
+    std::vector<std::string> features = {"rms", "loudness", "centroid"};
+    std::string mode = "window";
+    bool binary = true;
+    // 8 or 16 for quantized binary features, 0 for float32
+    unsigned int bits = 0;
+    double threshold = 0.01;
+    // multiple of real time frames are sent at
+    double speed = 1;
+    // seconds of audio each session sends
+    double duration = 10;
+    // seconds to wait for the last replies once every frame is sent
+    double drain = 2;
+};
+
+struct LoadSession {
+    unsigned int index = 0;
+    websocketpp::connection_hdl hdl;
+    std::unique_ptr<asio::steady_timer> timer;
+    bool confirmed = false;
+    bool rejected = false;
+    bool done = false;
+    uint32_t session_id = 0;
+    Clock::time_point next_send;
+    double phase = 0;
+    // send time of every frame, by sequence
+    std::vector<Clock::time_point> sent;
+    std::vector<bool> answered;
+    size_t next_reply = 0;
+    size_t unmatched = 0;
+};
+
+class LoadGenerator {
+public:
+    explicit LoadGenerator(const LoadOptions& options);
+
+    void run();
+
+    Json::Value report() const;
+
+private:
+    void on_open(LoadSession& session);
+    void on_message(LoadSession& session, LoadClient::message_ptr message);
+    void schedule(LoadSession& session);
+    void send_frame(LoadSession& session);
+    void reply(LoadSession& session, size_t sequence);
+    void finish(LoadSession& session);
+
+    LoadOptions options_;
+    asio::io_service io_service_;
+    LoadClient client_;
+    std::vector<std::unique_ptr<LoadSession>> sessions_;
+    asio::steady_timer drain_timer_;
+
+    size_t frames_per_session_;
+    Clock::duration interval_;
+    Clock::time_point start_;
+    Clock::time_point end_;
+    size_t failed_ = 0;
+    size_t finished_ = 0;
+    // round trip of every matched reply, in milliseconds
+    std::vector<double> latencies_;
+    // payload bytes of every audio_features reply
+    size_t feature_bytes_ = 0;
+
+    std::vector<float> samples_;
+    std::string message_;
+};
+
+LoadGenerator::LoadGenerator(const LoadOptions& options)
+    : options_(options), drain_timer_(io_service_) {
+    frames_per_session_ = std::ceil(options.duration * options.sample_rate / options.hop_size);
+    interval_ = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(
+        options.hop_size / (options.sample_rate * options.speed)));
+    samples_.resize(options.hop_size * options.channels);
+
+    client_.clear_access_channels(websocketpp::log::alevel::all);
+    client_.clear_error_channels(websocketpp::log::elevel::all);
+    client_.init_asio(&io_service_);
+}
+
+void LoadGenerator::run() {
+    for (unsigned int i = 0; i < options_.sessions; i++) {
+        sessions_.emplace_back(new LoadSession());
+        LoadSession& session = *sessions_.back();
+        session.index = i;
+        session.timer.reset(new asio::steady_timer(io_service_));
+        session.sent.reserve(frames_per_session_);
+        session.answered.reserve(frames_per_session_);
+
+        websocketpp::lib::error_code ec;
+        LoadClient::connection_ptr conn = client_.get_connection(options_.uri, ec);
+        if (ec) {
+            std::cerr << "cannot connect to " << options_.uri << ": " << ec.message() << std::endl;
+            failed_++;
+            session.done = true;
+            finished_++;
+            continue;
+        }
+
+        session.hdl = conn->get_handle();
+        conn->set_open_handler([this, &session](websocketpp::connection_hdl) { on_open(session); });
+        conn->set_message_handler(
+            [this, &session](websocketpp::connection_hdl, LoadClient::message_ptr message) {
+                on_message(session, message);
+            });
+        conn->set_fail_handler([this, &session](websocketpp::connection_hdl) {
+            failed_++;
+            finish(session);
+        });
+        conn->set_close_handler([this, &session](websocketpp::connection_hdl) { finish(session); });
+        client_.connect(conn);
+    }
+
+    start_ = Clock::now();
+    io_service_.run();
+    end_ = Clock::now();
+}
+
+void LoadGenerator::on_open(LoadSession& session) {
+    Json::Value features(Json::arrayValue);
+    for (auto const& feature : options_.features) {
+        features.append(feature);
+    }
+
+    Json::Value payload;
+    payload["sample_rate"] = options_.sample_rate;
+    payload["hop_size"] = options_.hop_size;
+    payload["channels"] = options_.channels;
+    payload["memory"] = options_.memory;
+    payload["features"] = features;
+    payload["mode"] = options_.mode;
+    payload["output"] = options_.binary ? "binary" : "json";
+    if (options_.bits != 0) {
+        payload["encoding"]["bits"] = options_.bits;
+        payload["encoding"]["threshold"] = options_.threshold;
+    }
+
+    Json::Value request;
+    request["type"] = "session_request";
+    request["payload"] = payload;
+
+    Json::StreamWriterBuilder writer;
+    writer["indentation"] = "";
+    websocketpp::lib::error_code ec;
+    client_.send(session.hdl, Json::writeString(writer, request),
+                 websocketpp::frame::opcode::text, ec);
+}
+
+void LoadGenerator::on_message(LoadSession& session, LoadClient::message_ptr message) {
+    const std::string& data = message->get_payload();
+
+    if (message->get_opcode() == websocketpp::frame::opcode::binary) {
+        feature_bytes_ += data.size();
+        QuantizedFeaturesHeader quantized;
+        FeaturesHeader header;
+        if (options_.bits != 0 &&
+            decode_quantized_features_header(data.data(), data.size(), quantized)) {
+            reply(session, quantized.features.frame_sequence);
+        } else if (options_.bits == 0 &&
+                   decode_features_header(data.data(), data.size(), header)) {
+            reply(session, header.frame_sequence);
+        }
+        return;
+    }
+
+    Json::Value root;
+    Json::Reader reader;
+    if (!reader.parse(data, root)) {
+        return;
+    }
+
+    std::string type = root["type"].asString();
+    if (type == "audio_features") {
+        feature_bytes_ += data.size();
+        auto& payload = root["payload"];
+        if (payload.isMember("frame_sequence")) {
+            reply(session, payload["frame_sequence"].asUInt());
+        } else {
+            reply(session, session.next_reply++);
+        }
+    } else if (type == "subscription_confirmation" && !session.confirmed) {
+        if (root["payload"]["status"].asString() != "ok") {
+            session.rejected = true;
+            finish(session);
+            return;
+        }
+
+        session.confirmed = true;
+        session.session_id = root["payload"]["session_id"].asUInt();
+        session.next_send = Clock::now();
+        schedule(session);
+    }
+}
+
+// Sends the next frame at its time, which does not drift however late the timer fires
+void LoadGenerator::schedule(LoadSession& session) {
+    session.timer->expires_at(session.next_send);
+    session.timer->async_wait([this, &session](const asio::error_code& ec) {
+        if (ec || session.done) {
+            return;
+        }
+
+        send_frame(session);
+        if (session.sent.size() >= frames_per_session_) {
+            finish(session);
+            return;
+        }
+
+        session.next_send += interval_;
+        schedule(session);
+    });
+}
+
+void LoadGenerator::send_frame(LoadSession& session) {
+    // a quiet tone, each session at its own pitch
+    double step = 2 * M_PI * (220 + 20 * session.index) / options_.sample_rate;
+    for (size_t i = 0; i < samples_.size(); i += options_.channels) {
+        std::fill_n(samples_.begin() + i, options_.channels, 0.25f * std::sin(session.phase));
+        session.phase += step;
+    }
+    session.phase = std::fmod(session.phase, 2 * M_PI);
+
+    websocketpp::lib::error_code ec;
+    if (options_.binary) {
+        AudioFrameHeader header = {session.session_id, static_cast<uint32_t>(session.sent.size()),
+                                   static_cast<uint32_t>(samples_.size()),
+                                   SAMPLE_FORMAT_FLOAT32, 0};
+        message_.resize(AUDIO_FRAME_HEADER_SIZE + samples_.size() * sizeof(float));
+        encode_audio_frame_header(header, &message_[0]);
+        encode_values(samples_.data(), samples_.size(), &message_[AUDIO_FRAME_HEADER_SIZE]);
+        client_.send(session.hdl, message_.data(), message_.size(),
+                     websocketpp::frame::opcode::binary, ec);
+    } else {
+        Json::Value payload(Json::arrayValue);
+        for (auto sample : samples_) {
+            payload.append(sample);
+        }
+
+        Json::Value frame;
+        frame["type"] = "audio_frame";
+        frame["sequence"] = Json::UInt(session.sent.size());
+        frame["payload"] = payload;
+
+        Json::StreamWriterBuilder writer;
+        writer["indentation"] = "";
+        client_.send(session.hdl, Json::writeString(writer, frame),
+                     websocketpp::frame::opcode::text, ec);
+    }
+
+    session.sent.push_back(Clock::now());
+    session.answered.push_back(false);
+}
+
+void LoadGenerator::reply(LoadSession& session, size_t sequence) {
+    if (sequence >= session.sent.size() || session.answered[sequence]) {
+        session.unmatched++;
+        return;
+    }
+
+    session.answered[sequence] = true;
+    std::chrono::duration<double, std::milli> latency = Clock::now() - session.sent[sequence];
+    latencies_.push_back(latency.count());
+}
+
+// Once every session is done sending, the last replies get `drain` seconds to arrive
+void LoadGenerator::finish(LoadSession& session) {
+    if (session.done) {
+        return;
+    }
+    session.done = true;
+
+    if (++finished_ < sessions_.size()) {
+        return;
+    }
+
+    drain_timer_.expires_after(
+        std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options_.drain)));
+    drain_timer_.async_wait([this](const asio::error_code&) {
+        for (auto const& session : sessions_) {
+            websocketpp::lib::error_code ec;
+            client_.close(session->hdl, websocketpp::close::status::normal, "done", ec);
+        }
+    });
+}
+
+static double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t index = std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()));
+    return sorted[index];
+}
+
+Json::Value LoadGenerator::report() const {
+    size_t sent = 0;
+    size_t unmatched = 0;
+    size_t rejected = 0;
+    size_t confirmed = 0;
+    for (auto const& session : sessions_) {
+        sent += session->sent.size();
+        unmatched += session->unmatched;
+        rejected += session->rejected;
+        confirmed += session->confirmed;
+    }
+
+    std::vector<double> sorted = latencies_;
+    std::sort(sorted.begin(), sorted.end());
+    double elapsed = std::chrono::duration<double>(end_ - start_).count();
+
+    double total = 0;
+    for (auto latency : sorted) {
+        total += latency;
+    }
+
+    Json::Value latency;
+    latency["p50"] = percentile(sorted, 0.50);
+    latency["p90"] = percentile(sorted, 0.90);
+    latency["p99"] = percentile(sorted, 0.99);
+    latency["max"] = sorted.empty() ? 0 : sorted.back();
+    latency["mean"] = sorted.empty() ? 0 : total / sorted.size();
+
+    Json::Value result;
+    result["uri"] = options_.uri;
+    result["sessions"] = options_.sessions;
+    result["confirmed"] = Json::UInt64(confirmed);
+    result["rejected"] = Json::UInt64(rejected);
+    result["failed"] = Json::UInt64(failed_);
+    result["sample_rate"] = options_.sample_rate;
+    result["hop_size"] = options_.hop_size;
+    result["channels"] = options_.channels;
+    result["memory"] = options_.memory;
+    result["mode"] = options_.mode;
+    result["output"] = options_.binary ? "binary" : "json";
+    result["bits"] = options_.bits;
+    result["speed"] = options_.speed;
+    result["elapsed_seconds"] = elapsed;
+    result["frames_sent"] = Json::UInt64(sent);
+    result["replies"] = Json::UInt64(sorted.size() + unmatched);
+    result["matched"] = Json::UInt64(sorted.size());
+    result["missing"] = Json::UInt64(sent - sorted.size());
+    result["unmatched"] = Json::UInt64(unmatched);
+    result["frames_per_second"] = elapsed > 0 ? sent / elapsed : 0;
+    result["replies_per_second"] = elapsed > 0 ? (sorted.size() + unmatched) / elapsed : 0;
+    result["feature_bytes"] = Json::UInt64(feature_bytes_);
+    result["bytes_per_reply"] =
+        sorted.size() + unmatched > 0 ? double(feature_bytes_) / (sorted.size() + unmatched) : 0;
+    result["latency_ms"] = latency;
+    return result;
+}
+
+static std::vector<std::string> parse_names(const std::string& list) {
+    std::vector<std::string> names;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            names.push_back(item);
+        }
+    }
+    return names;
+}
+
+static void usage() {
+    std::cerr << "usage: mirlin_loadgen [options]\n"
+                 "  --uri <uri>               ws://localhost:9002\n"
+                 "  --sessions <count>        8\n"
+                 "  --sample-rate <hz>        44100\n"
+                 "  --hop-size <samples>      512\n"
+                 "  --memory <hops>           4\n"
+                 "  --channels <count>        1\n"
+                 "  --features <f1,f2,...>    rms,loudness,centroid\n"
+                 "  --mode <window|streaming> window\n"
+                 "  --output <binary|json>    binary\n"
+                 "  --bits <0|8|16>           0, float32 binary features\n"
+                 "  --threshold <fraction>    0.01, change of quantized features sent again\n"
+                 "  --speed <factor>          1, real time\n"
+                 "  --duration <seconds>      10 seconds of audio per session\n"
+                 "  --drain <seconds>         2"
+              << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    LoadOptions options;
+
+    for (int i = 1; i < argc; i += 2) {
+        std::string name = argv[i];
+        if (i + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        std::string value = argv[i + 1];
+
+        if (name == "--uri") {
+            options.uri = value;
+        } else if (name == "--sessions") {
+            options.sessions = std::atoi(value.c_str());
+        } else if (name == "--sample-rate") {
+            options.sample_rate = std::atoi(value.c_str());
+        } else if (name == "--hop-size") {
+            options.hop_size = std::atoi(value.c_str());
+        } else if (name == "--channels") {
+            options.channels = std::atoi(value.c_str());
+        } else if (name == "--memory") {
+            options.memory = std::atoi(value.c_str());
+        } else if (name == "--features") {
+            options.features = parse_names(value);
+        } else if (name == "--mode") {
+            options.mode = value;
+        } else if (name == "--output") {
+            options.binary = value != "json";
+        } else if (name == "--bits") {
+            options.bits = std::atoi(value.c_str());
+        } else if (name == "--threshold") {
+            options.threshold = std::atof(value.c_str());
+        } else if (name == "--speed") {
+            options.speed = std::atof(value.c_str());
+        } else if (name == "--duration") {
+            options.duration = std::atof(value.c_str());
+        } else if (name == "--drain") {
+            options.drain = std::atof(value.c_str());
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    if (options.sessions == 0 || options.sample_rate == 0 || options.hop_size == 0 ||
+        options.channels == 0 || options.speed <= 0) {
+        usage();
+        return 1;
+    }
+
+    LoadGenerator generator(options);
+    generator.run();
+
+    Json::StreamWriterBuilder writer;
+    writer["indentation"] = "";
+    std::cout << Json::writeString(writer, generator.report()) << std::endl;
+
+    return 0;
+}
@@ -1,25 +1,164 @@
+#include <algorithm>
 #include <asio/io_service.hpp>
+#include <cmath>
+#include <cstdlib>
 #include <iostream>
+#include <sstream>
 #include <thread>
 #include <vector>
 
+#include <essentia/algorithmfactory.h>
+
 #include "Analyzer.hpp"
+#include "BatchAnalyzer.hpp"
+#include "Metrics.hpp"
+#include "SessionManager.hpp"
 #include "WebsocketServer.hpp"
 
 #define PORT_NUMBER 9002
+#define MAX_SESSIONS 32
+#define MAX_CHANNELS 8u
+// sample rates the server analyses audio at, in Hz
+#define MIN_SAMPLE_RATE 8000
+#define MAX_SAMPLE_RATE 384000
+#define MAX_HOP_SIZE 65536
+#define MAX_MEMORY 1024
+// longest audio window a session may ask for, hop_size * memory
+#define MAX_WINDOW_SECONDS 60
+// longest history the running stats of a session may cover, in seconds and in hops
+#define MAX_HORIZON_SECONDS 60
+#define MAX_HORIZON_HOPS 8192
+// delivery limits a session may ask for, in messages per second and bytes
+#define MIN_DELIVERY_RATE 0.1
+#define MAX_DELIVERY_RATE 1000
+#define MAX_DELIVERY_BUFFERED (16 * 1024 * 1024)
+
+// Checks that a field of a session_request payload is a whole number from min to max
+static bool check_uint(const Json::Value& payload, const char* name, unsigned int min,
+                       unsigned int max, std::string& error) {
+    const Json::Value& value = payload[name];
+    if (!value.isUInt() || value.asUInt() < min || value.asUInt() > max) {
+        error = std::string("\"") + name + "\" must be a whole number from " +
+                std::to_string(min) + " to " + std::to_string(max);
+        return false;
+    }
+    return true;
+}
+
+// Checks that an optional field of a session_request payload is a number from min to max
+static bool check_number(const Json::Value& payload, const char* name, double min, double max,
+                         std::string& error) {
+    const Json::Value& value = payload[name];
+    if (!value.isNull() &&
+        (!value.isNumeric() || !(value.asDouble() >= min) || !(value.asDouble() <= max))) {
+        std::ostringstream message;
+        message << "\"" << name << "\" must be a number from " << min << " to " << max;
+        error = message.str();
+        return false;
+    }
+    return true;
+}
+
+// Rejects session_request payloads whose numbers the analysis cannot run with, such as a hop
+// size of 0 it would divide by, with an error for the client
+static bool check_session_request(const Json::Value& payload, std::string& error) {
+    if (!payload.isObject()) {
+        error = "the payload must be an object";
+        return false;
+    }
+    if (!check_uint(payload, "sample_rate", MIN_SAMPLE_RATE, MAX_SAMPLE_RATE, error) ||
+        !check_uint(payload, "hop_size", 1, MAX_HOP_SIZE, error) ||
+        !check_uint(payload, "memory", 1, MAX_MEMORY, error)) {
+        return false;
+    }
+    if (payload.isMember("channels") && !check_uint(payload, "channels", 1, MAX_CHANNELS, error)) {
+        return false;
+    }
+
+    // 0 keeps the client's rate
+    const Json::Value& analysis_rate = payload["analysis_rate"];
+    if (!analysis_rate.isNull() && !(analysis_rate.isUInt() && analysis_rate.asUInt() == 0) &&
+        !check_uint(payload, "analysis_rate", MIN_SAMPLE_RATE, MAX_SAMPLE_RATE, error)) {
+        error += ", or 0";
+        return false;
+    }
+
+    double seconds = static_cast<double>(payload["hop_size"].asUInt()) *
+                     payload["memory"].asUInt() / payload["sample_rate"].asUInt();
+    if (seconds > MAX_WINDOW_SECONDS) {
+        error = "hop_size * memory must be at most " + std::to_string(MAX_WINDOW_SECONDS) +
+                " seconds of audio";
+        return false;
+    }
+
+    // 0 keeps the stats over `memory` hops, every other horizon is a pipeline of its own
+    if (!check_number(payload, "horizon", 0, MAX_HORIZON_SECONDS, error)) {
+        return false;
+    }
+    double hops = payload.get("horizon", 0).asDouble() * payload["sample_rate"].asUInt() /
+                  payload["hop_size"].asUInt();
+    if (std::lround(hops) > MAX_HORIZON_HOPS) {
+        error = "\"horizon\" must be at most " + std::to_string(MAX_HORIZON_HOPS) + " hops";
+        return false;
+    }
+
+    const Json::Value& delivery = payload["delivery"];
+    if (!delivery.isNull()) {
+        if (!delivery.isObject()) {
+            error = "\"delivery\" must be an object";
+            return false;
+        }
+        // 0 sends messages as fast as the client reads them
+        const Json::Value& max_rate = delivery["max_rate"];
+        if (!(max_rate.isNumeric() && max_rate.asDouble() == 0) &&
+            !check_number(delivery, "max_rate", MIN_DELIVERY_RATE, MAX_DELIVERY_RATE, error)) {
+            error += ", or 0";
+            return false;
+        }
+        if (delivery.isMember("max_buffered") &&
+            !check_uint(delivery, "max_buffered", 0, MAX_DELIVERY_BUFFERED, error)) {
+            return false;
+        }
+    }
+    return true;
+}
 
-// TODO
-// - validate connections when receiving messages
-// - fix session ending so clients can disconnect and connect again
 int main(int argc, char* argv[]) {
+    essentia::init();
+
+    // `server analyze <input> <output> ...` analyses a file offline instead of serving clients
+    if (argc > 1 && std::string(argv[1]) == "analyze") {
+        return analyze_file_command(argc, argv);
+    }
+
+    // `server --analysis-rate <hz>` resamples every session's audio to that rate by default
+    unsigned int analysis_rate = 0;
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) != "--analysis-rate") {
+            continue;
+        }
+
+        const char* value = i + 1 < argc ? argv[++i] : "";
+        char* end;
+        long rate = std::strtol(value, &end, 10);
+        if (end == value || *end != '\0' || rate < MIN_SAMPLE_RATE || rate > MAX_SAMPLE_RATE) {
+            std::cerr << "--analysis-rate must be a sample rate from " << MIN_SAMPLE_RATE << " to "
+                      << MAX_SAMPLE_RATE << " Hz, got \"" << value << "\"" << std::endl;
+            return 1;
+        }
+        analysis_rate = static_cast<unsigned int>(rate);
+    }
+
     std::clog << "Starting the mirlin server..." << std::endl;
 
-    // Create the event loop for the main thread, and the WebSocket server
+    // Create the event loop for the main thread, the WebSocket server and the analysis sessions
     asio::io_service main_event_loop;
     WebsocketServer server;
-    Analyzer analyzer;
+    SessionManager sessions(MAX_SESSIONS);
 
-    // Register our network callbacks, ensuring the logic is run on the main thread's event loop
+    // Register our network callbacks. Session lifecycle logic runs on the main thread's event
+    // loop, since ending a session joins its analyzer threads; audio frames and features are
+    // handled on the networking threads, on the strand of their connection.
     server.connect([&main_event_loop, &server](ClientConnection conn) {
         main_event_loop.post([conn, &server]() {
             std::clog << "Connection opened." << std::endl;
@@ -28,22 +167,51 @@ int main(int argc, char* argv[]) {
         });
     });
 
-    server.disconnect([&main_event_loop, &server, &analyzer](ClientConnection conn) {
-        main_event_loop.post([conn, &server, &analyzer]() {
+    server.disconnect([&main_event_loop, &server, &sessions](ClientConnection conn) {
+        main_event_loop.post([conn, &server, &sessions]() {
             std::clog << "Connection closed." << std::endl;
             std::clog << "There are now " << server.num_connections() << " open connections."
                       << std::endl;
-            analyzer.end_session();
-            std::clog << "Analyzer busy: " << analyzer.is_busy() << std::endl;
+            sessions.end_session(conn);
+            std::clog << "There are now " << sessions.num_sessions() << " active sessions."
+                      << std::endl;
         });
     });
 
-    server.message("session_request", [&main_event_loop, &server,
-                                       &analyzer](ClientConnection conn, const Json::Value& args) {
-        std::clog << "Session request - analyzer busy: " << analyzer.is_busy() << std::endl;
-        main_event_loop.post([conn, args, &server, &analyzer]() {
-            if (analyzer.is_busy()) {
-                // TODO: respond with error and disconnect
+    server.message("session_request", [&main_event_loop, &server, &sessions,
+                                       analysis_rate](ClientConnection conn,
+                                                      const Json::Value& args) {
+        main_event_loop.post([conn, args, &main_event_loop, &server, &sessions, analysis_rate]() {
+            std::string error;
+            if (!check_session_request(args["payload"], error)) {
+                std::clog << "Session request rejected: " << error << std::endl;
+
+                Json::Value payload;
+                payload["status"] = "error";
+                payload["error"] = error;
+
+                Json::Value rejection;
+                rejection["payload"] = payload;
+
+                server.send_message(conn, "subscription_confirmation", rejection);
+                return;
+            }
+
+            auto session = sessions.create_session(conn);
+            if (!session) {
+                std::clog << "Session request rejected: " << sessions.max_sessions()
+                          << " sessions already active" << std::endl;
+
+                Json::Value payload;
+                payload["status"] = "error";
+                payload["error"] = "server is at its maximum of " +
+                                   std::to_string(sessions.max_sessions()) + " sessions";
+
+                Json::Value rejection;
+                rejection["payload"] = payload;
+
+                server.send_message(conn, "subscription_confirmation", rejection);
+                server.close(conn, "too many sessions");
                 return;
             }
 
@@ -68,10 +236,126 @@ int main(int argc, char* argv[]) {
                 features.push_back(feature);
             }
 
-            analyzer.start_session(conn, sample_rate, hop_size, memory, features);
+            // "json" (default) or "binary" for packed float32 audio_features messages
+            auto output = args["payload"].get("output", "json").asString();
+            std::clog << "\toutput: " << output << std::endl;
+            session->set_binary_output(output == "binary");
+
+            // "window" (default) re-analyses the whole memory window every hop, "streaming"
+            // analyses only the newest hop and keeps the results of the previous ones
+            auto mode = args["payload"].get("mode", "window").asString();
+            std::clog << "\tmode: " << mode << std::endl;
+            session->set_streaming(mode == "streaming");
+
+            // interleaved channels of the audio frames, each analysed on its own, and the mixes
+            // of them analysed besides: "none" (default), "sum" or "mid_side" for stereo
+            auto channels = args["payload"].get("channels", 1).asUInt();
+            auto mix = args["payload"].get("mix", "none").asString();
+            std::clog << "\tchannels: " << channels << ", mix: " << mix << std::endl;
+            ChannelMix channel_mix = MIX_NONE;
+            if (mix == "sum") {
+                channel_mix = MIX_SUM;
+            } else if (mix == "mid_side") {
+                channel_mix = MIX_MID_SIDE;
+            }
+            session->set_channels(std::min(channels, MAX_CHANNELS), channel_mix);
+
+            // rate the audio is resampled to before it is analysed, 0 for none
+            auto session_rate = args["payload"].get("analysis_rate", analysis_rate).asUInt();
+            std::clog << "\tanalysis_rate: " << session_rate << std::endl;
+            session->set_analysis_rate(session_rate);
+
+            // stats of the aggregated features, "mean" and "var" unless any are listed
+            unsigned int stats = 0;
+            for (auto const& stat : args["payload"]["stats"]) {
+                stats |= parse_stat(stat.asString());
+            }
+            session->set_stats(stats != 0 ? stats : DEFAULT_STATS);
+
+            // seconds of history the stats cover in streaming mode, `memory` hops by default
+            auto horizon = args["payload"].get("horizon", 0).asDouble();
+            std::clog << "\thorizon: " << horizon << std::endl;
+            if (horizon > 0) {
+                session->set_horizon(std::lround(horizon * sample_rate / hop_size));
+            }
+
+            // how features reach clients that read them slower than they are produced:
+            // "queue" (default) or "latest", optionally limited to max_rate messages per second
+            auto delivery = args["payload"]["delivery"];
+            DeliveryOptions options;
+            options.policy =
+                delivery.get("policy", "queue").asString() == "latest" ? DELIVERY_LATEST
+                                                                       : DELIVERY_QUEUE;
+            options.max_rate = delivery.get("max_rate", options.max_rate).asDouble();
+            options.max_queue = delivery.get("max_queue", Json::UInt(options.max_queue)).asUInt();
+            options.max_buffered =
+                delivery.get("max_buffered", Json::UInt(options.max_buffered)).asUInt();
+            std::clog << "\tdelivery: " << (options.policy == DELIVERY_LATEST ? "latest" : "queue")
+                      << std::endl;
+
+            // significant digits of JSON feature values, 1 to 9: 9 reads back the exact float
+            options.precision = args["payload"].get("precision", options.precision).asUInt();
+
+            // binary messages can quantize their values to 8 or 16 bits, and then leave out the
+            // features that barely changed since the last message
+            auto json_encoding = args["payload"]["encoding"];
+            EncodingOptions encoding;
+            encoding.bits = json_encoding.get("bits", encoding.bits).asUInt();
+            encoding.threshold = json_encoding.get("threshold", encoding.threshold).asDouble();
+            encoding.key_interval =
+                json_encoding.get("key_interval", encoding.key_interval).asUInt();
+            if (!session->binary_output() || (encoding.bits != 8 && encoding.bits != 16)) {
+                encoding.bits = 0;
+            }
+            std::clog << "\tencoding bits: " << encoding.bits << std::endl;
+
+            // what to do with audio that arrives faster than it is analysed: "skip" (default)
+            // analyses only the newest hop once the oldest waiting frame is older than
+            // deadline_ms, "catch_up" analyses every hop in order
+            auto backlog = args["payload"]["backlog"];
+            auto backlog_policy = backlog.get("policy", "skip").asString();
+            std::clog << "\tbacklog: " << backlog_policy << std::endl;
+            session->set_backlog(backlog_policy == "catch_up" ? BACKLOG_CATCH_UP : BACKLOG_SKIP,
+                                 backlog.get("deadline_ms", 0).asUInt());
+
+            session->start_session(conn, sample_rate, hop_size, memory, features);
+            session->set_output(std::make_shared<FeatureOutput>(
+                server, conn, session->id(), session->binary_output(), options, encoding,
+                session->metrics()));
 
             Json::Value payload;
             payload["status"] = "ok";
+            payload["session_id"] = session->id();
+            payload["plan"] = session->plan().to_json();
+            if (session->sample_rate() != sample_rate) {
+                payload["analysis_rate"] = session->sample_rate();
+                payload["analysis_hop_size"] = session->hop_size();
+            }
+            if (session->streams().size() > 1) {
+                for (auto const& stream : session->streams()) {
+                    payload["streams"].append(stream);
+                }
+            }
+            if (session->binary_output()) {
+                const FeatureSchema& schema = session->schema();
+                payload["schema"] = schema.to_json();
+
+                // binary messages only carry the packed values: string features are left out
+                // and features with any number of values per hop only send their first
+                Json::Value dropped(Json::arrayValue);
+                for (auto const& label : schema.labels()) {
+                    dropped.append(label);
+                }
+                Json::Value truncated(Json::arrayValue);
+                for (auto const& events : schema.events()) {
+                    truncated.append(events);
+                }
+                payload["dropped"] = dropped;
+                payload["truncated"] = truncated;
+            }
+            if (encoding.bits != 0) {
+                payload["encoding"] = encoding.to_json();
+            }
 
             Json::Value confirmation;
             confirmation["payload"] = payload;
@@ -81,68 +365,83 @@ int main(int argc, char* argv[]) {
         });
     });
 
-    // TODO make sure the correct client is requesting to close the session
     server.message("session_end",
-                   [&main_event_loop, &analyzer](ClientConnection conn, const Json::Value& args) {
-                       main_event_loop.post([&analyzer]() {
-                           if (analyzer.is_busy()) {
-                               analyzer.end_session();
-                           }
-                       });
+                   [&main_event_loop, &sessions](ClientConnection conn, const Json::Value& args) {
+                       main_event_loop.post([conn, &sessions]() { sessions.end_session(conn); });
                    });
 
-    // TODO make sure the correct client is sending a frame
-    server.message("audio_frame", [&main_event_loop, &analyzer](ClientConnection conn,
-                                                                const Json::Value& args) {
-        main_event_loop.post([conn, args, &analyzer]() {
-            auto json_frame = args["payload"];
-            std::vector<float> frame;
+    // Audio frames are buffered on the connection's strand, which makes it the single producer
+    // of its session's ring buffer whichever networking thread runs it
+    server.message("audio_frame", [&sessions](ClientConnection conn, const Json::Value& args) {
+        // frames are only accepted from connections that own a session
+        auto session = sessions.get_session(conn);
+        if (!session) {
+            return;
+        }
 
-            for (Json::Value::ArrayIndex i = 0; i != json_frame.size(); i++) {
-                float sample = json_frame[i].asFloat();
-                frame.push_back(sample);
+        // the samples are converted straight into the session's buffer
+        auto& json_frame = args["payload"];
+        auto convert = [&json_frame](float* out, size_t first, size_t n) {
+            for (size_t i = 0; i < n; i++) {
+                out[i] = json_frame[Json::Value::ArrayIndex(first + i)].asFloat();
             }
+        };
 
-            analyzer.buffer_frame(frame);
-        });
+        // the sequence is optional for JSON frames, the session numbers them otherwise
+        auto sequence = args.isMember("sequence") ? long(args["sequence"].asUInt()) : -1;
+        session->buffer_samples(json_frame.size(), convert, sequence);
     });
 
-    analyzer.handle_features([&main_event_loop, &server, &analyzer](ClientConnection conn, Features features) {
-        main_event_loop.post([conn, features, &server, &analyzer]() {
-            // abort if the session has ended
-            if (!analyzer.is_busy()) {
-                return;
-            }
-
-            Json::Value json_features;
-            for (auto const& iter : features) {
-                std::string feature = iter.first;
-                std::vector<Real> vec = iter.second;
+    // Binary audio frames are decoded on the connection's strand straight into the session's
+    // buffer
+    server.binary_message([&sessions](ClientConnection conn, const std::string& message) {
+        AudioFrameHeader header;
+        if (!decode_audio_frame_header(message.data(), message.size(), header)) {
+            std::clog << "Invalid binary audio frame" << std::endl;
+            return;
+        }
 
-                Json::Value feature_vec;
-                for (int i = 0; i < vec.size(); i++) {
-                    feature_vec[i] = vec[i];
-                }
+        auto session = sessions.get_session(conn);
+        if (!session || session->id() != header.session_id) {
+            return;
+        }
 
-                json_features[feature] = feature_vec;
-            }
+        session->buffer_pcm(message.data() + AUDIO_FRAME_HEADER_SIZE, header.sample_count,
+                            static_cast<SampleFormat>(header.format), header.sequence);
+    });
 
-            Json::Value payload;
-            payload["features"] = json_features;
+    // Features go from the analyzer thread straight to the output, which serialises and sends
+    // them on the connection's strand
+    sessions.handle_features([&sessions](ClientConnection conn, unsigned int sequence,
+                                         std::shared_ptr<FeatureFrame> frame) {
+        // abort if the session has ended
+        auto session = sessions.get_session(conn);
+        auto output = session ? session->output() : nullptr;
+        if (!output) {
+            frame->release();
+            return;
+        }
 
-            Json::Value features_msg;
-            features_msg["payload"] = payload;
+        output->push(sequence, frame);
+    });
 
-            server.send_message(conn, "audio_features", features_msg);
-        });
+    // Prometheus metrics, served over plain HTTP on the websocket port
+    server.http("/metrics", [](std::string& content_type) {
+        content_type = "text/plain; version=0.0.4";
+        return Metrics::instance().render();
     });
 
-    // Start the networking thread
-    std::thread server_thread([&server]() { server.run(PORT_NUMBER); });
+    // Start the networking threads, one per core
+    unsigned int network_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::clog << "Serving on " << network_threads << " networking threads" << std::endl;
+    std::thread server_thread(
+        [&server, network_threads]() { server.run(PORT_NUMBER, network_threads); });
 
     // Start the event loop for the main thread
     asio::io_service::work work(main_event_loop);
     main_event_loop.run();
 
+    sessions.end_all();
+
     return 0;
 }
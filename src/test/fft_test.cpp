@@ -0,0 +1,98 @@
+// Compares the magnitudes of RealFft with those of essentia's Windowing and Spectrum, which the
+// window mode computes, over the frame sizes the FFT supports. Exits with an error on the first
+// size whose spectra differ by more than a float32 rounding error.
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <essentia/algorithmfactory.h>
+
+#include "FeatureGraph.hpp"
+#include "FftCache.hpp"
+#include "Pipeline.hpp"
+
+using essentia::Real;
+
+// error allowed, relative to the largest magnitude of the spectrum
+#define TOLERANCE 1e-4
+
+static bool compare(size_t size) {
+    PipelineConfig config;
+    essentia::ParameterMap parameters =
+        FeatureGraph::instance().node("windowing")->parameters(config, size);
+
+    std::minstd_rand random(size);
+    std::uniform_real_distribution<Real> noise(-1, 1);
+    std::vector<Real> frame(size);
+    for (size_t i = 0; i < size; i++) {
+        frame[i] = 0.5 * std::sin(0.05 * i) + 0.5 * noise(random);
+    }
+
+    std::vector<Real> windowed;
+    std::vector<Real> expected;
+    essentia::standard::AlgorithmFactory& factory =
+        essentia::standard::AlgorithmFactory::instance();
+    essentia::standard::Algorithm* windowing = factory.create("Windowing");
+    essentia::standard::Algorithm* spectrum = factory.create("Spectrum", "size", int(size));
+    windowing->configure(parameters);
+    windowing->input("frame").set(frame);
+    windowing->output("frame").set(windowed);
+    spectrum->input("frame").set(windowed);
+    spectrum->output("spectrum").set(expected);
+    windowing->compute();
+    spectrum->compute();
+    delete windowing;
+    delete spectrum;
+
+    auto fft = FftCache::instance().fft(size);
+    auto window = FftCache::instance().window(parameters, size);
+    std::vector<FftComplex> workspace(fft->workspace_size());
+    std::vector<Real> actual(fft->bins());
+    fft->magnitudes(frame.data(), window->window.data(), workspace.data(), actual.data());
+
+    if (actual.size() != expected.size()) {
+        std::cerr << "size " << size << ": " << actual.size() << " bins, essentia has "
+                  << expected.size() << std::endl;
+        return false;
+    }
+
+    Real peak = *std::max_element(expected.begin(), expected.end());
+    for (size_t k = 0; k < actual.size(); k++) {
+        if (std::fabs(actual[k] - expected[k]) > TOLERANCE * std::max(peak, Real(1))) {
+            std::cerr << "size " << size << ", bin " << k << ": " << actual[k]
+                      << ", essentia has " << expected[k] << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int main() {
+    essentia::init();
+
+    // powers of two, hop sizes times memory at 44.1kHz and 48kHz rates, and odd sizes
+    const size_t sizes[] = {4,     64,    100,   256,  512,  882,  1000,  1024,  1323,  2048,
+                            2205,  3000,  4096,  4410, 6615, 8192, 8820,  16384, 32768, 65536,
+                            75,    243,   1001,  3375, 11025, 24000, 48000, 96000};
+    bool passed = true;
+    for (size_t size : sizes) {
+        if (!RealFft::supported(size)) {
+            std::cerr << "size " << size << " is not supported" << std::endl;
+            passed = false;
+            continue;
+        }
+        passed = compare(size) && passed;
+    }
+
+    // a large prime factor leaves the size to essentia
+    if (RealFft::supported(2 * 1031) || FftCache::instance().fft(2 * 1031)) {
+        std::cerr << "size " << 2 * 1031 << " should not be supported" << std::endl;
+        passed = false;
+    }
+
+    essentia::shutdown();
+    return passed ? 0 : 1;
+}
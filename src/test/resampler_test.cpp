@@ -0,0 +1,133 @@
+// Checks the Resampler on tones: frequencies below the passband edge keep their amplitude,
+// frequencies the output rate cannot hold are attenuated, and every frame yields as many output
+// frames as the ratio implies, whatever the frame size. Exits with an error if any check fails.
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "Resampler.hpp"
+
+// largest passband ripple up to 0.8 of the lower Nyquist frequency, and largest stopband level
+// from 1.1 of it
+#define PASSBAND_DB 0.05
+#define STOPBAND_DB -75.0
+// output frames skipped before measuring, while the filter's history fills
+#define SETTLE_FRAMES 1000
+
+static bool passed = true;
+
+static void fail(const std::string& check, unsigned int input_rate, unsigned int output_rate,
+                 double value) {
+    std::cerr << check << " " << input_rate << " -> " << output_rate << " Hz: " << value
+              << std::endl;
+    passed = false;
+}
+
+// Resamples a tone of the given frequency on the first of two channels, in frames of the given
+// sizes in turn, and returns the output of both channels interleaved
+static std::vector<float> resample_tone(unsigned int input_rate, unsigned int output_rate,
+                                        double frequency, const std::vector<size_t>& frame_sizes,
+                                        size_t total_frames) {
+    Resampler resampler(input_rate, output_rate, 2);
+    std::vector<float> output;
+    size_t position = 0;
+    double produced = 0;
+    for (size_t i = 0; position < total_frames; i++) {
+        size_t frames = std::min(frame_sizes[i % frame_sizes.size()], total_frames - position);
+        float* input = resampler.input(frames * 2);
+        for (size_t j = 0; j < frames; j++) {
+            input[2 * j] = std::sin(2 * M_PI * frequency * (position + j) / input_rate);
+            input[2 * j + 1] = 0;
+        }
+        position += frames;
+
+        // the output keeps up with the input to within a frame
+        size_t count = resampler.process(frames);
+        produced += count;
+        double expected = static_cast<double>(position) * output_rate / input_rate;
+        if (std::fabs(produced - expected) > 1) {
+            fail("output frames", input_rate, output_rate, produced - expected);
+            break;
+        }
+        output.insert(output.end(), resampler.output(), resampler.output() + count * 2);
+    }
+    return output;
+}
+
+// Amplitude of a channel's component at the frequency, once settled
+static double amplitude(const std::vector<float>& output, size_t channel, double frequency,
+                        unsigned int rate) {
+    double re = 0;
+    double im = 0;
+    size_t n = 0;
+    for (size_t i = SETTLE_FRAMES; 2 * i + channel < output.size(); i++) {
+        double phase = 2 * M_PI * frequency * i / rate;
+        re += output[2 * i + channel] * std::cos(phase);
+        im += output[2 * i + channel] * std::sin(phase);
+        n++;
+    }
+    return n > 0 ? 2 * std::sqrt(re * re + im * im) / n : 0;
+}
+
+// Largest magnitude of a channel, once settled
+static double peak(const std::vector<float>& output, size_t channel) {
+    double largest = 0;
+    for (size_t i = SETTLE_FRAMES; 2 * i + channel < output.size(); i++) {
+        largest = std::max(largest, std::fabs(double(output[2 * i + channel])));
+    }
+    return largest;
+}
+
+static double decibels(double amplitude) { return 20 * std::log10(std::max(amplitude, 1e-12)); }
+
+static void check(unsigned int input_rate, unsigned int output_rate) {
+    double nyquist = std::min(input_rate, output_rate) / 2.0;
+    std::vector<size_t> frame_sizes = {512, 441, 1000, 333, 1, 4096};
+    size_t total_frames = input_rate;
+
+    // tones across the passband, at whole frequencies so that they are measured exactly
+    for (double fraction : {0.05, 0.4, 0.8}) {
+        double frequency = std::round(fraction * nyquist);
+        std::vector<float> output =
+            resample_tone(input_rate, output_rate, frequency, frame_sizes, total_frames);
+        double gain = decibels(amplitude(output, 0, frequency, output_rate));
+        if (std::fabs(gain) > PASSBAND_DB) {
+            fail("passband gain (dB)", input_rate, output_rate, gain);
+        }
+        // the silent channel stays silent
+        if (peak(output, 1) != 0) {
+            fail("crosstalk", input_rate, output_rate, peak(output, 1));
+        }
+    }
+
+    // tones the output rate cannot hold, which would alias, where the input rate has them
+    for (double fraction : {1.1, 1.5}) {
+        double frequency = fraction * nyquist;
+        if (frequency >= 0.95 * input_rate / 2) {
+            continue;
+        }
+        std::vector<float> output =
+            resample_tone(input_rate, output_rate, frequency, frame_sizes, total_frames);
+        double level = decibels(peak(output, 0));
+        if (level > STOPBAND_DB) {
+            fail("stopband level (dB)", input_rate, output_rate, level);
+        }
+    }
+}
+
+int main() {
+    const unsigned int rates[][2] = {{44100, 22050}, {48000, 44100}, {96000, 44100},
+                                     {44100, 48000}, {22050, 44100}, {16000, 44100},
+                                     {44100, 16000}, {32000, 32000}};
+    for (auto const& rate : rates) {
+        check(rate[0], rate[1]);
+    }
+
+    if (Resampler::supported(44100, 44101) || !Resampler::supported(48000, 44100)) {
+        fail("supported", 44100, 44101, Resampler::supported(44100, 44101));
+    }
+
+    return passed ? 0 : 1;
+}